@@ -0,0 +1,123 @@
+#include <TcpConnection.hpp>
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+namespace {
+
+const size_t kDefaultConnections = 100000;
+const size_t kMessageSize = 100;
+
+size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// 每个连接占两个fd（socketpair的两端），fd上限不够时按上限缩减连接数
+size_t connectionLimit(size_t wanted) {
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    // 有权限时同时提高硬上限，否则退回到硬上限
+    limit.rlim_max = std::max<rlim_t>(limit.rlim_max, 2 * wanted + 128);
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) == -1) {
+        getrlimit(RLIMIT_NOFILE, &limit);
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    getrlimit(RLIMIT_NOFILE, &limit);
+    size_t fds = limit.rlim_cur > 128 ? static_cast<size_t>(limit.rlim_cur) - 128 : 0;
+    return std::min(wanted, fds / 2);
+}
+
+void report(const char* phase, size_t bytes, size_t count) {
+    std::cout << phase << ": RSS " << static_cast<double>(bytes) / (1024.0 * 1024.0) << " MiB, "
+              << static_cast<double>(bytes) / static_cast<double>(count) << " bytes/connection" << std::endl;
+}
+
+} // anonymous namespace
+
+/**
+ * 建立大量注册在同一个EventLoop上的空闲连接（默认十万个，可由第一个参数指定），统计每个连接的RSS。
+ * 然后向每个连接写入一条消息，等全部被消息回调消费后再统计一次：读缓冲区由loop共享，
+ * 收发过数据的连接回到空闲后也不应再占用缓冲区内存
+**/
+int main(int argc, char* argv[]) {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_WARN);
+    size_t wanted = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : kDefaultConnections;
+    size_t count = connectionLimit(wanted);
+    if (count < wanted) {
+        std::cout << "RLIMIT_NOFILE allows only " << count << " connections" << std::endl;
+    }
+
+    EventLoop loop;
+    size_t received = 0;
+    auto callbacks = std::make_shared<TcpConnectionCallbacks>();
+    callbacks->message = [&](const TcpConnectionPtr&, Buffer& buffer) {
+        received += buffer.readableBytes();
+        buffer.retrieveAll();
+        if (received == count * kMessageSize) {
+            loop.quit();
+        }
+    };
+    callbacks->close = [](const TcpConnectionPtr&) {};
+
+    std::vector<TcpConnectionPtr> conns;
+    std::vector<int> peers;
+    conns.reserve(count);
+    peers.reserve(count);
+    InetAddress addr;
+
+    size_t base = residentBytes();
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == -1) {
+            SYSFATAL("socketpair");
+        }
+        auto conn = std::make_shared<TcpConnection>(&loop, fds[0], addr, addr);
+        conn->setCallbacks(callbacks);
+        conn->connectEstablished();
+        conns.push_back(std::move(conn));
+        peers.push_back(fds[1]);
+    }
+    auto setupMs = duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count();
+    std::cout << count << " connections established in " << setupMs << " ms" << std::endl;
+    report("idle", residentBytes() - base, count);
+
+    std::string message(kMessageSize, 'x');
+    for (int fd : peers) {
+        if (::write(fd, message.data(), message.size()) != static_cast<ssize_t>(message.size())) {
+            SYSFATAL("write");
+        }
+    }
+    loop.runAfter(30s, [&]() { loop.quit(); });
+    loop.loop();
+    report("idle after one message each", residentBytes() - base, count);
+
+    for (auto& conn : conns) {
+        conn->forceClose();
+    }
+    loop.runAfter(100ms, [&]() { loop.quit(); });
+    loop.loop();
+    conns.clear();
+    for (int fd : peers) {
+        ::close(fd);
+    }
+    return 0;
+}
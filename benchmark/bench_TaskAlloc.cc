@@ -0,0 +1,91 @@
+#include <EventLoop.hpp>
+#include <EventLoopThread.hpp>
+#include <Logger.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <iostream>
+
+using namespace mudong::ev;
+
+// 统计全局分配次数
+std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+const size_t kBatch = 1000;
+const size_t kWarmupRounds = 10;
+const size_t kRounds = 1000;
+
+std::atomic_size_t executed(0);
+
+/**
+ * 另一个线程向EventLoop投递与TcpConnection::send相同形状的任务（捕获一个shared_ptr和一个std::string），
+ * 每批等loop执行完再投递下一批。预热之后统计每个任务平均的堆分配次数
+**/
+template <typename Callable>
+void run(const char* name) {
+    EventLoopThread thread;
+    EventLoop* loop = thread.startLoop();
+
+    auto conn = std::make_shared<int>(0);
+    auto round = [&]() {
+        size_t target = executed.load() + kBatch;
+        for (size_t i = 0; i < kBatch; ++i) {
+            Callable callable = [ptr = conn, str = std::string("hello")]() {
+                (void)ptr;
+                (void)str;
+                executed.fetch_add(1, std::memory_order_relaxed);
+            };
+            loop->queueInLoop(Task(std::move(callable)));
+        }
+        while (executed.load() < target) {
+            std::this_thread::yield();
+        }
+    };
+    for (size_t i = 0; i < kWarmupRounds; ++i) {
+        round();
+    }
+
+    size_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRounds; ++i) {
+        round();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    size_t count = allocations.load() - before;
+
+    double tasks = static_cast<double>(kBatch * kRounds);
+    std::cout << name << ": " << kBatch * kRounds << " tasks, " << static_cast<double>(count) / tasks
+              << " allocations/task, " << elapsed.count() * 1e9 / tasks << " ns/task" << std::endl;
+}
+
+} // anonymous namespace
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_WARN);
+    // 先包装成std::function再转成Task，相当于原先Task = std::function<void()>时的开销
+    run<std::function<void()>>("std::function");
+    run<Task>("Task");
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <MpscQueue.hpp>
+#include <Callbacks.hpp>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+using namespace mudong::ev;
+
+namespace {
+
+const size_t kProducers = 8;
+const size_t kTasksPerProducer = 200000;
+
+// 原EventLoop::queueInLoop/doPendingTasks的做法：加锁push_back，消费者交换出整个vector
+class MutexQueue {
+public:
+    void push(Task&& task) {
+        std::lock_guard<std::mutex> guard(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+
+    template <typename Func>
+    size_t drain(Func&& func) {
+        std::vector<Task> tasks;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            tasks.swap(tasks_);
+        }
+        for (auto& task : tasks) {
+            func(task);
+        }
+        return tasks.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Task> tasks_;
+};
+
+template <typename Queue>
+double run(const char* name) {
+    Queue queue;
+    std::atomic_size_t executed(0);
+    const size_t total = kProducers * kTasksPerProducer;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < kProducers; ++i) {
+        producers.emplace_back([&]() {
+            for (size_t j = 0; j < kTasksPerProducer; ++j) {
+                queue.push([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); });
+            }
+        });
+    }
+    size_t drained = 0;
+    while (drained < total) {
+        drained += queue.drain([](Task& task) { task(); });
+    }
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double mops = static_cast<double>(total) / elapsed.count() / 1e6;
+    std::cout << name << ": " << total << " tasks, " << kProducers << " producers, "
+              << elapsed.count() * 1000 << " ms, " << mops << " Mtasks/s" << std::endl;
+    return mops;
+}
+
+} // anonymous namespace
+
+int main() {
+    run<MutexQueue>("mutex + vector");
+    run<MpscQueue<Task>>("lock-free mpsc");
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <random>
+#include <vector>
+#include <iostream>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+namespace {
+
+const size_t kTimers = 1000000;
+
+// 在loop线程中添加一百万个1s~60s后到期的定时器，再全部取消
+void run(TimerEngine::Type type) {
+    EventLoop loop;
+    loop.setTimerEngine(type);
+
+    std::mt19937_64 rng(2023);
+    std::uniform_int_distribution<int64_t> dist(1000, 60000);
+    std::vector<Milliseconds> delays(kTimers);
+    for (auto& delay : delays) {
+        delay = Milliseconds(dist(rng));
+    }
+    std::vector<TimerId> timers(kTimers);
+
+    auto start = steady_clock::now();
+    for (size_t i = 0; i < kTimers; ++i) {
+        timers[i] = loop.runAfter(delays[i], [](){});
+    }
+    auto added = steady_clock::now();
+    for (TimerId id : timers) {
+        loop.cancelTimer(id);
+    }
+    auto canceled = steady_clock::now();
+
+    auto addMs = duration_cast<duration<double, std::milli>>(added - start).count();
+    auto cancelMs = duration_cast<duration<double, std::milli>>(canceled - added).count();
+    std::cout << TimerEngine::typeName(type) << ": add " << kTimers << " timers " << addMs << " ms ("
+              << addMs * 1e6 / kTimers << " ns/op), cancel " << cancelMs << " ms ("
+              << cancelMs * 1e6 / kTimers << " ns/op)" << std::endl;
+}
+
+} // anonymous namespace
+
+int main() {
+    run(TimerEngine::Type::kOrderedSet);
+    run(TimerEngine::Type::kTimingWheel);
+    return 0;
+}
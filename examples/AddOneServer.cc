@@ -1,7 +1,6 @@
 #include <iostream>
 #include <future>
 #include <string>
-#include <unordered_map>
 
 #include <TcpServer.hpp>
 #include <EventLoop.hpp>
@@ -21,16 +20,18 @@ public:
               server_(loop, addr),
               threadNums_(threadNums),
               timeout_(timeout),
-              timer_(loop->runEvery(timeout_, [this](){onTimeout();})),
               threadPool_(threadPoolSize)
     {
+        // 超过timeout_没有收到数据的连接由TcpServer在各自的EventLoop中强制关闭
+        server_.setIdleTimeout(timeout_);
         server_.setConnectionCallback(std::bind(&AddOneServer::onConnection, this, std::placeholders::_1));
         server_.setMessageCallback(std::bind(&AddOneServer::onMessage, this, std::placeholders::_1, std::placeholders::_2));
-        server_.setWriteCompleteCallback(std::bind(&AddOneServer::onWriteComplete, this, std::placeholders::_1));
-    }
-
-    ~AddOneServer() {
-        loop_->cancelTimer(timer_);
+        // 回应积压超过1KB时暂停读取，写完后恢复；未消费的输入超过64KB的连接直接关闭
+        FlowControl flowControl;
+        flowControl.outputHighWater = 1024;
+        flowControl.inputLimit = 64 * 1024;
+        flowControl.inputPolicy = InputLimitPolicy::kClose;
+        server_.setFlowControl(flowControl);
     }
 
     void start() {
@@ -40,11 +41,6 @@ public:
 
     void onConnection(const TcpConnectionPtr& conn) {
         INFO("connection {} is {}", conn->name(), conn->connected() ? "up" : "down");
-
-        if (conn->connected()) {
-            conn->setHighWaterMarkCallback(std::bind(&AddOneServer::onHighWaterMark, this, std::placeholders::_1, std::placeholders::_2), 1024);
-        }
-        else connections_.erase(conn);
     }
 
     void onMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
@@ -66,48 +62,13 @@ public:
         std::string res = std::to_string(res_future.get());
         buffer.append(res + "\n");
         conn->send(buffer);
-
-        expireAfter(conn, timeout_);
-    }
-
-    void onWriteComplete(const TcpConnectionPtr& conn) {
-        if (!conn->isReading()) {
-            INFO("write complete, start read");
-            conn->startRead();
-            expireAfter(conn, timeout_);
-        }
-    }
-
-    void onHighWaterMark(const TcpConnectionPtr& conn, size_t mark) {
-        INFO("high water mark {} byte(s), stop read", mark);
-        conn->stopRead();
-        expireAfter(conn, 2 * timeout_);
     }
 
 private:
-    void onTimeout() {
-        for (auto iter = connections_.begin(); iter != connections_.end(); ) {
-            if (iter->second <= clock::now()) {
-                INFO("connection timeout force close");
-                iter->first->forceClose();
-                iter = connections_.erase(iter);
-            }
-            else iter++;
-        }
-    }
-
-    void expireAfter(const TcpConnectionPtr& conn, Nanoseconds interval) {
-        connections_[conn] = clock::nowAfter(interval);
-    }
-
-    using ConnectionList = std::unordered_map<TcpConnectionPtr, Timestamp>;
-    
     EventLoop* loop_;
     TcpServer server_;
     const size_t threadNums_;
     const Nanoseconds timeout_;
-    Timer* timer_;
-    ConnectionList connections_;
     ThreadPool threadPool_;
 };
 
@@ -1,4 +1,3 @@
-#include <unordered_map>
 #include <thread>
 #include <string>
 #include <iostream>
@@ -19,18 +18,15 @@ public:
             : loop_(loop),
               server_(loop, addr),
               threadNums_(threadNums),
-              timeout_(timeout),
-              timer_(loop_->runEvery(timeout_, [this](){onTimeout();}))
+              timeout_(timeout)
     {
+        // 超过timeout_没有收到数据的连接由TcpServer在各自的EventLoop中强制关闭
+        server_.setIdleTimeout(timeout_);
         server_.setConnectionCallback(std::bind(&EchoServer::onConnection, this, std::placeholders::_1));
         server_.setMessageCallback(std::bind(&EchoServer::onMessage, this, std::placeholders::_1, std::placeholders::_2));
         server_.setWriteCompleteCallback(std::bind(&EchoServer::onWriteComplete, this, std::placeholders::_1));
     }
 
-    ~EchoServer() {
-        loop_->cancelTimer(timer_);
-    }
-
     void start()
     {
         server_.setNumThread(threadNums_);
@@ -42,9 +38,7 @@ public:
 
         if (conn->connected()) {
             conn->setHighWaterMarkCallback(std::bind(&EchoServer::onHighWaterMark, this, std::placeholders::_1, std::placeholders::_2), 1024);
-            expireAfter(conn, timeout_);
         }
-        else connections_.erase(conn);
     }
 
     void onMessage(const TcpConnectionPtr& conn, Buffer& buffer) {
@@ -55,47 +49,25 @@ public:
 
         // 发送并清空buffer
         conn->send(buffer);
-        
-        expireAfter(conn, timeout_);
     }
 
     void onWriteComplete(const TcpConnectionPtr& conn) {
         if (!conn->isReading()) {
             INFO("write complete, start read");
             conn->startRead();
-            expireAfter(conn, timeout_);
         }
     }
 
     void onHighWaterMark(const TcpConnectionPtr& conn, size_t mark) {
         INFO("high water mark {} byte(s), stop read", mark);
-        conn->stopRead();
-        expireAfter(conn, 2 * timeout_);
+        conn->stopRead(); // 暂停读取期间不会被当作读空闲
     }
 
 private:
-    void onTimeout() {
-        for (auto iter = connections_.begin(); iter != connections_.end(); ) {
-            if (iter->second <= clock::now()) {
-                INFO("connection timeout force close");
-                iter->first->forceClose();
-                iter = connections_.erase(iter);
-            }
-            else iter++;
-        }
-    }
-
-    void expireAfter(const TcpConnectionPtr& conn, Nanoseconds interval) {
-        connections_[conn] = clock::nowAfter(interval);
-    }
-
     EventLoop* loop_;
     TcpServer server_;
     const size_t threadNums_;
     const Nanoseconds timeout_;
-    Timer* timer_;
-    using ConnectionList = std::unordered_map<TcpConnectionPtr, Timestamp>;
-    ConnectionList connections_;
 
 };
 
@@ -2,6 +2,9 @@
 #include "Logger.hpp"
 #include "EventLoop.hpp"
 
+#include <fcntl.h>
+#include <linux/filter.h>
+
 using namespace mudong::ev;
 
 namespace {
@@ -20,8 +23,18 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& local)
           loop_(loop),
           acceptfd_(createSocket()),
           acceptChannel_(loop, acceptfd_),
-          local_(local)
+          local_(local),
+          acceptBatch_(kDefaultAcceptBatch),
+          idleFd_(::open("/dev/null", O_RDONLY | O_CLOEXEC)),
+          accepted_(0),
+          rejected_(0),
+          acceptRate_(0),
+          rateWindowStart_(loop->now()),
+          rateWindowCount_(0)
 {
+    if (idleFd_ == -1) {
+        SYSFATAL("Acceptor open /dev/null");
+    }
     int on = 1;
     int ret = setsockopt(acceptfd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
     if (ret == -1) {
@@ -37,8 +50,21 @@ Acceptor::Acceptor(EventLoop* loop, const InetAddress& local)
     }
 }
 
+const Channel::Handlers Acceptor::kChannelHandlers = {
+    [](void* owner) { static_cast<Acceptor*>(owner)->handleRead(); },
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
+
 Acceptor::~Acceptor() {
+    loop_->cancelTimer(rateTimer_);
+    loop_->cancelTimer(retryTimer_);
     close(acceptfd_);
+    if (idleFd_ != -1) {
+        close(idleFd_);
+    }
 }
 
 bool Acceptor::listening() const {
@@ -51,38 +77,149 @@ void Acceptor::listen() {
     if (ret == -1) {
         SYSFATAL("Acceptor listen fatal");
     }
-    acceptChannel_.setReadCallback([this](){handleRead();}); // 当有连接请求到来时，交由handleRead处理
+    acceptChannel_.setHandlers(&kChannelHandlers, this); // 当有连接请求到来时，交由handleRead处理
     acceptChannel_.enableRead();
+    rateWindowStart_ = loop_->now();
+    rateTimer_ = loop_->runEvery(Seconds(1), [this](){publishRate();});
 }
 
 void Acceptor::setNewConnectionCallback(const NewConnectionCallback& callback) {
     newConnectionCallback_ = callback;
 }
 
+void Acceptor::setAcceptBatch(int batch) {
+    assert(batch > 0);
+    acceptBatch_ = batch;
+}
+
+Acceptor::Stats Acceptor::stats() const {
+    return Stats{
+        accepted_.load(std::memory_order_relaxed),
+        rejected_.load(std::memory_order_relaxed),
+        acceptRate_.load(std::memory_order_relaxed)
+    };
+}
+
+void Acceptor::setIncomingCpu(int cpu) {
+    if (setsockopt(acceptfd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == -1) {
+        SYSERR("Acceptor setsockopt SO_INCOMING_CPU");
+    }
+}
+
+bool Acceptor::attachCpuSteering(const std::vector<int>& cpus) {
+    assert(!cpus.empty());
+    // A = 当前CPU；逐个比较，命中cpus[i]时返回i；都不命中时返回A % 组大小
+    std::vector<struct sock_filter> code;
+    code.push_back({static_cast<uint16_t>(BPF_LD | BPF_W | BPF_ABS), 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)});
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        code.push_back({static_cast<uint16_t>(BPF_JMP | BPF_JEQ | BPF_K), 0, 1, static_cast<uint32_t>(cpus[i])});
+        code.push_back({static_cast<uint16_t>(BPF_RET | BPF_K), 0, 0, static_cast<uint32_t>(i)});
+    }
+    code.push_back({static_cast<uint16_t>(BPF_ALU | BPF_MOD | BPF_K), 0, 0, static_cast<uint32_t>(cpus.size())});
+    code.push_back({static_cast<uint16_t>(BPF_RET | BPF_A), 0, 0, 0});
+    if (code.size() > BPF_MAXINSNS) {
+        ERROR("Acceptor::attachCpuSteering() too many cpus {}", cpus.size());
+        return false;
+    }
+
+    struct sock_fprog prog;
+    prog.len = static_cast<unsigned short>(code.size());
+    prog.filter = code.data();
+    if (setsockopt(acceptfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1) {
+        SYSERR("Acceptor setsockopt SO_ATTACH_REUSEPORT_CBPF");
+        return false;
+    }
+    return true;
+}
+
 void Acceptor::handleRead() {
     loop_->assertInLoopThread();
 
-    struct sockaddr_in addr;
-    socklen_t len = sizeof(addr);
-
-    int sockfd = ::accept4(acceptfd_, reinterpret_cast<sockaddr*>(&addr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
-    if (sockfd == -1) {
-        int savedErrno = errno;
-        SYSERR("Acceptor accept4()");
-        switch (savedErrno) {
-            case ECONNABORTED: // connection aborted
-            case EMFILE: // 文件描述符用完了
-                ERROR(strerror(savedErrno)); // log输出两种错误类型
+    // 一次可读事件中尽量取空backlog，连接风暴时减少poll的轮数
+    uint64_t accepted = 0;
+    for (int i = 0; i < acceptBatch_; ++i) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        int sockfd = ::accept4(acceptfd_, reinterpret_cast<sockaddr*>(&addr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sockfd == -1) {
+            int savedErrno = errno;
+            if (savedErrno == EAGAIN) {
                 break;
-            default:
-                FATAL("unexpected accept4() error");
+            }
+            SYSERR("Acceptor accept4()");
+            switch (savedErrno) {
+                case EINTR:
+                case ECONNABORTED: // connection aborted
+                case EPROTO:
+                case EPERM:
+                    continue; // 只影响这一个连接
+                case EMFILE: // 文件描述符用完了
+                case ENFILE:
+                    if (rejectOne()) {
+                        continue;
+                    }
+                    break; // 已暂停读事件
+                case ENOBUFS:
+                case ENOMEM:
+                    break; // 等待下一次可读事件再试
+                default:
+                    FATAL("unexpected accept4() error");
+            }
+            break;
+        }
+
+        if (newConnectionCallback_) {
+            InetAddress peer;
+            peer.setAddress(addr);
+            newConnectionCallback_(sockfd, local_, peer);
         }
+        else ::close(sockfd);
+        ++accepted;
+    }
+    if (accepted > 0) {
+        accepted_.fetch_add(accepted, std::memory_order_relaxed);
+        rateWindowCount_ += accepted;
     }
+}
 
-    if (newConnectionCallback_) {
-        InetAddress peer;
-        peer.setAddress(addr);
-        newConnectionCallback_(sockfd, local_, peer);
+bool Acceptor::rejectOne() {
+    if (idleFd_ != -1) {
+        ::close(idleFd_);
+    }
+    int sockfd = ::accept4(acceptfd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (sockfd != -1) {
+        ::close(sockfd);
+        rejected_.fetch_add(1, std::memory_order_relaxed);
     }
-    else ::close(sockfd);
-}
\ No newline at end of file
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (idleFd_ == -1) {
+        SYSERR("Acceptor reopen /dev/null, pause accepting");
+        acceptChannel_.disableRead();
+        retryTimer_ = loop_->runAfter(kRejectRetryInterval, [this](){resumeAccepting();});
+        return false;
+    }
+    return true;
+}
+
+void Acceptor::resumeAccepting() {
+    retryTimer_ = TimerId();
+    idleFd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (idleFd_ == -1) {
+        retryTimer_ = loop_->runAfter(kRejectRetryInterval, [this](){resumeAccepting();});
+        return;
+    }
+    acceptChannel_.enableRead();
+}
+
+void Acceptor::publishRate() {
+    // 定时器可能被推迟，按实际经过的时间折算成每秒的连接数；没有新连接时发布0
+    Timestamp now = loop_->now();
+    Nanoseconds elapsed = now - rateWindowStart_;
+    if (elapsed > Nanoseconds::zero()) {
+        uint64_t perSecond = rateWindowCount_ * static_cast<uint64_t>(Nanoseconds(Seconds(1)).count()) /
+                             static_cast<uint64_t>(elapsed.count());
+        acceptRate_.store(perSecond, std::memory_order_relaxed);
+    }
+    rateWindowStart_ = now;
+    rateWindowCount_ = 0;
+}
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <vector>
+
 #include "noncopyable.hpp"
 #include "InetAddress.hpp"
 #include "Channel.hpp"
 #include "Callbacks.hpp"
+#include "Timestamp.hpp"
+#include "TimerId.hpp"
 
 namespace mudong {
 
@@ -14,6 +19,17 @@ class EventLoop;
 class Acceptor: noncopyable {
 
 public:
+    static const int kDefaultAcceptBatch = 64;
+
+    // 可以在任意线程中读取
+    struct Stats {
+        uint64_t accepted;
+        // fd耗尽时接受后立即关闭的连接
+        uint64_t rejected;
+        // 最近一个窗口内每秒接受的连接数，由定时器每秒按实际经过的时间发布，空闲时降为0
+        uint64_t acceptRate;
+    };
+
     Acceptor(EventLoop*, const InetAddress&);
     ~Acceptor();
 
@@ -22,16 +38,49 @@ public:
     void listen();
 
     void setNewConnectionCallback(const NewConnectionCallback& callback);
+    // 每次可读事件最多accept的连接数，backlog取空（EAGAIN）时提前结束
+    void setAcceptBatch(int batch);
+
+    Stats stats() const;
+
+    // 监听socket设置SO_INCOMING_CPU，标明这个acceptor在哪个CPU上处理连接
+    void setIncomingCpu(int cpu);
+    /**
+     * 给所在的SO_REUSEPORT组挂上cBPF程序：取处理该连接数据包的CPU编号，cpus[i]上的连接交给组内第i个socket。
+     * 组内的顺序就是listen的顺序，要在组内所有socket都listen之后调用；不在cpus中的CPU按编号取模分配
+    **/
+    bool attachCpuSteering(const std::vector<int>& cpus);
 
 private:
+    static const Channel::Handlers kChannelHandlers;
+
+    // 预留的fd无法重新打开时，暂停accept的间隔
+    static constexpr Nanoseconds kRejectRetryInterval = Milliseconds(100);
+
     void handleRead();
-    
+    // fd耗尽时让出预留的fd，接受并立即关闭一个连接，使对端尽快得知而不是在backlog中等待超时。
+    // 预留的fd无法重新打开时暂停读事件并返回false，否则水平触发的监听fd会让loop空转
+    bool rejectOne();
+    // 重新打开预留的fd后恢复读事件，仍然失败则继续等待
+    void resumeAccepting();
+    void publishRate();
+
     bool listening_;
     EventLoop* loop_; // 指向的是主Reactor的EventLoop对象
     const int acceptfd_;
     Channel acceptChannel_;
     InetAddress local_;
     NewConnectionCallback newConnectionCallback_;
+    int acceptBatch_;
+    // 预留的空闲fd，只在EMFILE/ENFILE时临时关闭
+    int idleFd_;
+    std::atomic_uint64_t accepted_;
+    std::atomic_uint64_t rejected_;
+    std::atomic_uint64_t acceptRate_;
+    Timestamp rateWindowStart_;
+    uint64_t rateWindowCount_;
+    TimerId rateTimer_;
+    TimerId retryTimer_;
 };
 
 } // namespace ev
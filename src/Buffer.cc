@@ -4,6 +4,7 @@
 #include <sys/uio.h>
 
 #include <Buffer.hpp>
+#include <BufferPool.hpp>
 
 using namespace mudong::ev;
 
@@ -12,18 +13,58 @@ const char Buffer::kCRLF[] = "\r\n";
 const size_t Buffer::kCheapPrepend;
 const size_t Buffer::kInitialSize;
 
+bool Buffer::poolUsable() const
+{
+    return pool_ != nullptr && pool_.get() == BufferPool::current();
+}
+
+char* Buffer::allocateStorage(size_t size, size_t* capacity)
+{
+    if (poolUsable()) {
+        return static_cast<char*>(pool_->allocate(size, capacity));
+    }
+    *capacity = size;
+    return static_cast<char*>(::operator new(size));
+}
+
+void Buffer::freeStorage(char* data, size_t capacity)
+{
+    if (pool_ != nullptr) {
+        pool_->deallocate(data, capacity);
+    }
+    else ::operator delete(data);
+}
+
+void Buffer::adoptStorage(char* data, size_t capacity)
+{
+    if (data_ != nullptr) {
+        freeStorage(data_, capacity_);
+    }
+    if (!poolUsable()) {
+        pool_.reset();
+    }
+    data_ = data;
+    capacity_ = capacity;
+}
+
 ssize_t Buffer::readFd(int fd, int* savedErrno)
 {
     char extrabuf[65536];
+    return readFd(fd, savedErrno, extrabuf, sizeof extrabuf);
+}
+
+ssize_t Buffer::readFd(int fd, int* savedErrno, char* extrabuf, size_t extraLen)
+{
     struct iovec vec[2];
     const size_t writable = writableBytes();
     vec[0].iov_base = begin() + writerIndex_;
     vec[0].iov_len = writable;
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_len = extraLen;
     // when there is enough space in this buffer, don't read into extrabuf.
-    // when extrabuf is used, we read 128k-1 bytes at most.
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+    // when extrabuf is used, we read writable + extraLen bytes at most.
+    assert(writable > 0 || extrabuf != nullptr);
+    const int iovcnt = (extrabuf != nullptr && writable < extraLen) ? 2 : 1;
     const ssize_t n = ::readv(fd, vec, iovcnt);
 
     if (n < 0)
@@ -31,7 +72,7 @@ ssize_t Buffer::readFd(int fd, int* savedErrno)
     else if (static_cast<size_t>(n) <= writable)
         writerIndex_ += n;
     else {
-        writerIndex_ = buffer_.size();
+        writerIndex_ = capacity_;
         append(extrabuf, n - writable);
     }
     return n;
@@ -1,44 +1,86 @@
 // muduo::Buffer
 #pragma once
 
-#include <vector>
 #include <algorithm>
 #include <string>
 #include <cassert>
 #include <cstring>
+#include <memory>
 
 namespace mudong {
 
 namespace ev {
 
+class BufferPool;
+
 class Buffer
 {
 public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
 
-    explicit Buffer(size_t initialSize = kInitialSize)
-            : buffer_(kCheapPrepend + initialSize),
-              readerIndex_(kCheapPrepend),
-              writerIndex_(kCheapPrepend)
+    // initialSize为0时不分配存储，第一次写入时才分配（至少kInitialSize），空闲的Buffer不占内存
+    explicit Buffer(size_t initialSize = 0)
+            : data_(nullptr),
+              capacity_(0),
+              readerIndex_(0),
+              writerIndex_(0)
     {
+        if (initialSize > 0) {
+            allocate(initialSize);
+        }
         assert(readableBytes() == 0);
-        assert(writableBytes() == initialSize);
-        assert(prependableBytes() == kCheapPrepend);
+        assert(writableBytes() >= initialSize);
+    }
+
+    // 拷贝出来的Buffer使用全局分配器
+    Buffer(const Buffer &rhs)
+            : Buffer()
+    {
+        append(rhs.peek(), rhs.readableBytes());
+    }
+
+    Buffer(Buffer &&rhs) noexcept
+            : Buffer()
+    {
+        swap(rhs);
     }
 
-    void swap(Buffer &rhs)
+    Buffer &operator=(Buffer rhs)
     {
-        buffer_.swap(rhs.buffer_);
+        swap(rhs);
+        return *this;
+    }
+
+    ~Buffer()
+    { release(); }
+
+    void swap(Buffer &rhs) noexcept
+    {
+        std::swap(data_, rhs.data_);
+        std::swap(capacity_, rhs.capacity_);
         std::swap(readerIndex_, rhs.readerIndex_);
         std::swap(writerIndex_, rhs.writerIndex_);
+        std::swap(pool_, rhs.pool_);
     }
 
+    /**
+     * 之后的存储从pool中分配（TcpConnection使用所在loop的池），只能在还没有分配存储时调用。
+     * Buffer持有池的引用，可以在任意线程中析构；被移到其他线程后第一次重新分配时改用全局分配器
+    **/
+    void setPool(std::shared_ptr<BufferPool> pool)
+    {
+        assert(data_ == nullptr);
+        pool_ = std::move(pool);
+    }
+    const std::shared_ptr<BufferPool> &pool() const
+    { return pool_; }
+
     size_t readableBytes() const
     { return writerIndex_ - readerIndex_; }
 
     size_t writableBytes() const
-    { return buffer_.size() - writerIndex_; }
+    { return capacity_ - writerIndex_; }
 
     size_t prependableBytes() const
     { return readerIndex_; }
@@ -104,10 +146,26 @@ public:
 
     void retrieveAll()
     {
-        readerIndex_ = kCheapPrepend;
-        writerIndex_ = kCheapPrepend;
+        // 没有分配存储时下标保持为0
+        readerIndex_ = data_ == nullptr ? 0 : kCheapPrepend;
+        writerIndex_ = readerIndex_;
+    }
+
+    // 丢弃数据并归还存储，回到未分配的状态
+    void release()
+    {
+        if (data_ != nullptr) {
+            freeStorage(data_, capacity_);
+            data_ = nullptr;
+            capacity_ = 0;
+        }
+        readerIndex_ = 0;
+        writerIndex_ = 0;
     }
 
+    size_t internalCapacity() const
+    { return capacity_; }
+
     std::string retrieveAllAsString()
     { return retrieveAsString(readableBytes()); }
 
@@ -262,25 +320,58 @@ public:
 
     void prepend(const void *data, size_t len)
     {
+        if (data_ == nullptr) {
+            allocate(kInitialSize);
+        }
         assert(len <= prependableBytes());
         readerIndex_ -= len;
         auto d = static_cast<const char *>(data);
         std::copy(d, d + len, begin() + readerIndex_);
     }
 
+    // 可写空间不够时溢出到栈上的64KB缓冲区，再追加到本Buffer
     ssize_t readFd(int fd, int *savedErrno);
+    // 同上，溢出空间由调用者提供（例如EventLoop的共享读缓冲区），extrabuf为nullptr时只读入可写空间
+    ssize_t readFd(int fd, int *savedErrno, char *extrabuf, size_t extraLen);
 
 private:
     char *begin()
-    { return &*buffer_.begin(); }
+    { return data_; }
 
     const char *begin() const
-    { return &*buffer_.begin(); }
+    { return data_; }
+
+    // 只有在池所属的线程中才能从pool_分配
+    bool poolUsable() const;
+    // 从pool_或全局分配器中分配至少size字节，实际大小写入*capacity
+    char *allocateStorage(size_t size, size_t *capacity);
+    void freeStorage(char *data, size_t capacity);
+    // 释放原有存储并换成allocateStorage分配的data。不能使用池时解除绑定，此后data_一定来自全局分配器
+    void adoptStorage(char *data, size_t capacity);
+
+    void allocate(size_t len)
+    {
+        assert(data_ == nullptr);
+        size_t capacity;
+        char *data = allocateStorage(kCheapPrepend + len, &capacity);
+        adoptStorage(data, capacity);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = kCheapPrepend;
+    }
 
     void makeSpace(size_t len)
     {
-        if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
-            buffer_.resize(writerIndex_ + len);
+        if (data_ == nullptr) {
+            allocate(std::max(len, kInitialSize));
+        } else if (writableBytes() + prependableBytes() < len + kCheapPrepend) {
+            // 至少翻倍，搬到新存储时顺便把可读数据移到头部
+            size_t readable = readableBytes();
+            size_t capacity;
+            char *data = allocateStorage(std::max(kCheapPrepend + readable + len, 2 * capacity_), &capacity);
+            std::copy(begin() + readerIndex_, begin() + writerIndex_, data + kCheapPrepend);
+            adoptStorage(data, capacity);
+            readerIndex_ = kCheapPrepend;
+            writerIndex_ = readerIndex_ + readable;
         } else {
             assert(kCheapPrepend < readerIndex_);
             size_t readable = readableBytes();
@@ -294,9 +385,12 @@ private:
     }
 
 private:
-    std::vector<char> buffer_;
+    char *data_;
+    size_t capacity_;
     size_t readerIndex_;
     size_t writerIndex_;
+    // data_非空时，data_来自pool_当且仅当pool_非空
+    std::shared_ptr<BufferPool> pool_;
 
     static const char kCRLF[];
 };
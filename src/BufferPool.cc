@@ -0,0 +1,316 @@
+#include "BufferPool.hpp"
+#include "Logger.hpp"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+
+namespace {
+
+__thread BufferPool* t_bufferPool = nullptr;
+
+size_t pageSize() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+} // anonymous namespace
+
+/**
+ * arena头部，位于每个2MB对齐映射的起始处，块从kHeaderSize之后开始切分。
+ * 新块按bump指针顺序切出，只有真正分配过的页才会驻留内存
+**/
+struct BufferPool::Arena {
+    static const size_t kHeaderSize = 128;
+
+    // partial_中的链表
+    Arena* prev;
+    Arena* next;
+    // arenas_中的链表
+    Arena* allPrev;
+    Arena* allNext;
+    FreeBlock* freeList;
+    size_t carved;
+    size_t used;
+    size_t capacity;
+    int sizeClass;
+    bool huge;
+    bool inPartial;
+};
+
+const size_t BufferPool::kMinBlockSize;
+const size_t BufferPool::kMaxBlockSize;
+const size_t BufferPool::kArenaSize;
+
+BufferPool::BufferPool()
+        : hugePages_(false),
+          arenas_(nullptr),
+          remoteFrees_(nullptr),
+          hits_(0),
+          misses_(0),
+          mappedBytes_(0),
+          touchedBytes_(0),
+          usedBytes_(0)
+{
+    for (auto& head : partial_) {
+        head = nullptr;
+    }
+    assert(t_bufferPool == nullptr);
+    t_bufferPool = this;
+}
+
+BufferPool::~BufferPool() {
+    if (t_bufferPool == this) {
+        t_bufferPool = nullptr;
+    }
+    // 此时所有从池中分配的块都已经释放，直接归还全部arena
+    while (arenas_ != nullptr) {
+        unmapArena(arenas_);
+    }
+}
+
+void BufferPool::detach() {
+    assert(t_bufferPool == this);
+    drainRemoteFrees();
+    t_bufferPool = nullptr;
+}
+
+void BufferPool::setHugePages(bool on) {
+    assert(t_bufferPool == this);
+    hugePages_ = on;
+}
+
+bool BufferPool::hugePages() const {
+    return hugePages_;
+}
+
+BufferPool* BufferPool::current() {
+    return t_bufferPool;
+}
+
+void* BufferPool::allocate(size_t size, size_t* capacity) {
+    assert(t_bufferPool == this);
+    int sizeClass = classOf(size);
+    if (sizeClass < 0) {
+        increase<uint64_t>(misses_, 1);
+        *capacity = size;
+        return ::operator new(size);
+    }
+    if (partial_[sizeClass] == nullptr && remoteFrees_.load(std::memory_order_relaxed) != nullptr) {
+        drainRemoteFrees();
+    }
+
+    Arena* arena = partial_[sizeClass];
+    if (arena == nullptr) {
+        increase<uint64_t>(misses_, 1);
+        arena = newArena(sizeClass);
+    }
+    else increase<uint64_t>(hits_, 1);
+
+    void* block;
+    size_t blockSize = classSize(sizeClass);
+    if (arena->freeList != nullptr) {
+        block = arena->freeList;
+        arena->freeList = arena->freeList->next;
+    }
+    else {
+        assert(arena->carved < arena->capacity);
+        block = reinterpret_cast<char*>(arena) + Arena::kHeaderSize + arena->carved * blockSize;
+        size_t touched = touchedBytesOf(arena);
+        ++arena->carved;
+        increase(touchedBytes_, touchedBytesOf(arena) - touched);
+    }
+    if (++arena->used == arena->capacity) {
+        // 用满的arena移出partial_，有块释放时再放回
+        if (arena->next != nullptr) {
+            arena->next->prev = nullptr;
+        }
+        partial_[sizeClass] = arena->next;
+        arena->next = nullptr;
+        arena->inPartial = false;
+    }
+    increase(usedBytes_, blockSize);
+    *capacity = blockSize;
+    return block;
+}
+
+void BufferPool::deallocate(void* block, size_t size) {
+    if (size > kMaxBlockSize) {
+        ::operator delete(block);
+        return;
+    }
+    if (t_bufferPool == this) {
+        freeLocal(block);
+        return;
+    }
+    // 其他线程释放的块：块本身用作链表节点，CAS压入remoteFrees_
+    auto node = static_cast<FreeBlock*>(block);
+    node->next = remoteFrees_.load(std::memory_order_relaxed);
+    while (!remoteFrees_.compare_exchange_weak(node->next, node,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed))
+    {}
+}
+
+size_t BufferPool::trim() {
+    assert(t_bufferPool == this);
+    drainRemoteFrees();
+    size_t released = 0;
+    for (int i = 0; i < kClasses; ++i) {
+        Arena* arena = partial_[i];
+        while (arena != nullptr) {
+            Arena* next = arena->next;
+            if (arena->used == 0) {
+                released += kArenaSize;
+                unmapArena(arena);
+            }
+            arena = next;
+        }
+    }
+    return released;
+}
+
+BufferPool::Stats BufferPool::stats() const {
+    return Stats{
+        hits_.load(std::memory_order_relaxed),
+        misses_.load(std::memory_order_relaxed),
+        mappedBytes_.load(std::memory_order_relaxed),
+        touchedBytes_.load(std::memory_order_relaxed),
+        usedBytes_.load(std::memory_order_relaxed)
+    };
+}
+
+int BufferPool::classOf(size_t size) {
+    if (size > kMaxBlockSize) {
+        return -1;
+    }
+    int sizeClass = 0;
+    while (classSize(sizeClass) < size) {
+        ++sizeClass;
+    }
+    return sizeClass;
+}
+
+size_t BufferPool::classSize(int sizeClass) {
+    return kMinBlockSize << sizeClass;
+}
+
+BufferPool::Arena* BufferPool::arenaOf(void* block) {
+    auto addr = reinterpret_cast<uintptr_t>(block);
+    return reinterpret_cast<Arena*>(addr & ~(kArenaSize - 1));
+}
+
+size_t BufferPool::touchedBytesOf(const Arena* arena) {
+    if (arena->huge) {
+        return kArenaSize;
+    }
+    size_t end = Arena::kHeaderSize + arena->carved * classSize(arena->sizeClass);
+    return (end + pageSize() - 1) / pageSize() * pageSize();
+}
+
+BufferPool::Arena* BufferPool::newArena(int sizeClass) {
+    static_assert(sizeof(Arena) <= Arena::kHeaderSize, "arena header too large");
+    void* addr = MAP_FAILED;
+    bool huge = false;
+    if (hugePages_) {
+        // 大页映射天然按2MB对齐，需要系统预留了大页
+        addr = mmap(nullptr, kArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = addr != MAP_FAILED;
+    }
+    if (addr == MAP_FAILED) {
+        // 多映射一个arena的大小，再裁掉两端未对齐的部分
+        void* raw = mmap(nullptr, 2 * kArenaSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            SYSFATAL("BufferPool::mmap");
+        }
+        auto begin = reinterpret_cast<uintptr_t>(raw);
+        auto aligned = (begin + kArenaSize - 1) & ~(kArenaSize - 1);
+        if (aligned > begin) {
+            munmap(raw, aligned - begin);
+        }
+        size_t tail = begin + 2 * kArenaSize - (aligned + kArenaSize);
+        if (tail > 0) {
+            munmap(reinterpret_cast<void*>(aligned + kArenaSize), tail);
+        }
+        addr = reinterpret_cast<void*>(aligned);
+        if (hugePages_) {
+            madvise(addr, kArenaSize, MADV_HUGEPAGE);
+        }
+    }
+
+    auto arena = new (addr) Arena;
+    arena->prev = nullptr;
+    arena->next = nullptr;
+    arena->allPrev = nullptr;
+    arena->allNext = arenas_;
+    if (arenas_ != nullptr) {
+        arenas_->allPrev = arena;
+    }
+    arenas_ = arena;
+    arena->freeList = nullptr;
+    arena->carved = 0;
+    arena->used = 0;
+    arena->capacity = (kArenaSize - Arena::kHeaderSize) / classSize(sizeClass);
+    arena->sizeClass = sizeClass;
+    arena->huge = huge;
+    arena->inPartial = true;
+    partial_[sizeClass] = arena;
+    increase<size_t>(mappedBytes_, kArenaSize);
+    increase(touchedBytes_, touchedBytesOf(arena));
+    return arena;
+}
+
+void BufferPool::unmapArena(Arena* arena) {
+    if (arena->inPartial) {
+        if (arena->prev != nullptr) {
+            arena->prev->next = arena->next;
+        }
+        else partial_[arena->sizeClass] = arena->next;
+        if (arena->next != nullptr) {
+            arena->next->prev = arena->prev;
+        }
+    }
+    if (arena->allPrev != nullptr) {
+        arena->allPrev->allNext = arena->allNext;
+    }
+    else arenas_ = arena->allNext;
+    if (arena->allNext != nullptr) {
+        arena->allNext->allPrev = arena->allPrev;
+    }
+    decrease(touchedBytes_, touchedBytesOf(arena));
+    if (munmap(arena, kArenaSize) == -1) {
+        SYSERR("BufferPool::munmap");
+    }
+    decrease<size_t>(mappedBytes_, kArenaSize);
+}
+
+void BufferPool::freeLocal(void* block) {
+    Arena* arena = arenaOf(block);
+    auto node = static_cast<FreeBlock*>(block);
+    node->next = arena->freeList;
+    arena->freeList = node;
+    --arena->used;
+    decrease(usedBytes_, classSize(arena->sizeClass));
+    if (!arena->inPartial) {
+        arena->prev = nullptr;
+        arena->next = partial_[arena->sizeClass];
+        if (arena->next != nullptr) {
+            arena->next->prev = arena;
+        }
+        partial_[arena->sizeClass] = arena;
+        arena->inPartial = true;
+    }
+}
+
+void BufferPool::drainRemoteFrees() {
+    FreeBlock* node = remoteFrees_.exchange(nullptr, std::memory_order_acquire);
+    while (node != nullptr) {
+        FreeBlock* next = node->next;
+        freeLocal(node);
+        node = next;
+    }
+}
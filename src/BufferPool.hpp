@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "noncopyable.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+/**
+ * 每个EventLoop一个的分级slab内存池，为本loop上连接的Buffer与ChainBuffer提供存储。
+ * 大小分为1KB到64KB的7级，每级从2MB对齐的arena中切分，arena头部记录级别、空闲链表与使用计数，
+ * 释放时按地址对齐找到所属arena，不需要额外的查找表。超过64KB的请求直接交给全局分配器。
+ * 只有所属loop线程可以从池中分配；其他线程释放的块无锁地压入remoteFrees_，由loop线程下次分配或trim时回收。
+ * 完全空闲的arena保留在池中，直到调用trim()才归还给操作系统。
+ * 池由shared_ptr管理，连接各持有一份引用，因此总是比从池中分配的内存活得更久
+**/
+class BufferPool : noncopyable {
+
+public:
+    static const size_t kMinBlockSize = 1024;
+    static const size_t kMaxBlockSize = 64 * 1024;
+    static const size_t kArenaSize = 2 * 1024 * 1024;
+
+    struct Stats {
+        // 从已有arena中满足的分配
+        uint64_t hits;
+        // 需要映射新arena或者超过kMaxBlockSize的分配
+        uint64_t misses;
+        // 已映射的arena总大小，是mmap保留的地址空间，不是驻留内存
+        size_t mappedBytes;
+        // 已经写过、因而驻留的内存：每个arena的头部加上切分过的块，按页向上取整；大页arena整块计入。
+        // 释放回arena的块仍然驻留，所以这是驻留内存的上界，直到trim归还整个arena
+        size_t touchedBytes;
+        // 已分配出去的块的总大小
+        size_t usedBytes;
+    };
+
+    // 在所属loop线程中构造，构造后成为该线程的current()
+    BufferPool();
+    ~BufferPool();
+
+    // loop析构时在所属线程中调用，之后所有的释放都走remoteFrees_，由池析构时一并归还
+    void detach();
+
+    // 新映射的arena是否使用大页：先尝试MAP_HUGETLB，失败时退回普通映射加MADV_HUGEPAGE
+    void setHugePages(bool on);
+    bool hugePages() const;
+
+    // 只能在所属线程中调用。返回的块至少size字节，实际大小写入*capacity
+    void* allocate(size_t size, size_t* capacity);
+    // 可以在任意线程中调用，size为allocate返回的capacity
+    void deallocate(void* block, size_t size);
+
+    // 回收其他线程释放的块，并把完全空闲的arena归还给操作系统，返回归还的字节数。只能在所属线程中调用
+    size_t trim();
+
+    // 可以在任意线程中读取
+    Stats stats() const;
+
+    // 当前线程所属loop的内存池，没有时为nullptr
+    static BufferPool* current();
+
+private:
+    static const int kClasses = 7;
+
+    struct Arena;
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static int classOf(size_t size);
+    static size_t classSize(int sizeClass);
+    static Arena* arenaOf(void* block);
+    static size_t touchedBytesOf(const Arena* arena);
+
+    Arena* newArena(int sizeClass);
+    void unmapArena(Arena* arena);
+    void freeLocal(void* block);
+    void drainRemoteFrees();
+    // 统计只有所属线程写，用普通的load/store更新即可
+    template <typename T>
+    static void increase(std::atomic<T>& counter, T value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    template <typename T>
+    static void decrease(std::atomic<T>& counter, T value) {
+        counter.store(counter.load(std::memory_order_relaxed) - value, std::memory_order_relaxed);
+    }
+
+    bool hugePages_;
+    // 池中全部arena组成的双向链表
+    Arena* arenas_;
+    // 每级有空闲块的arena组成的双向链表
+    Arena* partial_[kClasses];
+    std::atomic<FreeBlock*> remoteFrees_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<size_t> mappedBytes_;
+    std::atomic<size_t> touchedBytes_;
+    std::atomic<size_t> usedBytes_;
+};
+
+} // namespace ev
+
+} // namespace mudong
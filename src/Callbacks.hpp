@@ -3,6 +3,8 @@
 #include <memory>
 #include <functional>
 
+#include "Task.hpp"
+
 namespace mudong {
 
 namespace ev {
@@ -12,6 +14,13 @@ class TcpConnection;
 class InetAddress;
 
 using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+
+// 连接在多长时间内没有读到数据（kRead）或没有写出数据（kWrite）
+enum class IdleKind {
+    kRead,
+    kWrite
+};
+
 using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
 using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
@@ -19,13 +28,15 @@ using HighWaterMarkCallback = std::function<void(const TcpConnectionPtr&, size_t
 using MessageCallback = std::function<void(const TcpConnectionPtr&, Buffer&)>;
 using ErrorCallback = std::function<void()>;
 using NewConnectionCallback = std::function<void(int sockfd, const InetAddress& local, const InetAddress& peer)>;
-using Task = std::function<void()>;
 using ThreadInitCallback = std::function<void(size_t)>;
 using TimerCallback = std::function<void()>;
+using IdleCallback = std::function<void(const TcpConnectionPtr&, IdleKind)>;
 
 void defaultThreadInitCallback(size_t);
 void defaultConnectionCallback(const TcpConnectionPtr&);
 void defaultMessageCallback(const TcpConnectionPtr&, Buffer&);
+// 打印日志并强制关闭连接
+void defaultIdleCallback(const TcpConnectionPtr&, IdleKind);
 
 } // namespace ev
 
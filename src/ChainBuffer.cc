@@ -0,0 +1,260 @@
+#include "ChainBuffer.hpp"
+#include "BufferPool.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <sys/uio.h>
+
+using namespace mudong::ev;
+
+const size_t ChainBuffer::kBlockBytes;
+const size_t ChainBuffer::kBlockSize;
+
+ChainBuffer::ChainBuffer()
+        : head_(nullptr),
+          tail_(nullptr),
+          spare_(nullptr),
+          readable_(0),
+          blocks_(0)
+{}
+
+ChainBuffer::~ChainBuffer() {
+    release();
+}
+
+ChainBuffer::ChainBuffer(ChainBuffer&& rhs) noexcept
+        : ChainBuffer()
+{
+    swap(rhs);
+}
+
+ChainBuffer& ChainBuffer::operator=(ChainBuffer&& rhs) noexcept {
+    if (this != &rhs) {
+        release();
+        swap(rhs);
+    }
+    return *this;
+}
+
+void ChainBuffer::swap(ChainBuffer& rhs) noexcept {
+    std::swap(head_, rhs.head_);
+    std::swap(tail_, rhs.tail_);
+    std::swap(spare_, rhs.spare_);
+    std::swap(readable_, rhs.readable_);
+    std::swap(blocks_, rhs.blocks_);
+    std::swap(pool_, rhs.pool_);
+}
+
+void ChainBuffer::setPool(std::shared_ptr<BufferPool> pool) {
+    assert(blocks_ == 0);
+    pool_ = std::move(pool);
+}
+
+bool ChainBuffer::poolUsable() const {
+    return pool_ != nullptr && pool_.get() == BufferPool::current();
+}
+
+size_t ChainBuffer::contiguousBytes() const {
+    return head_ == nullptr ? 0 : head_->writeIndex - head_->readIndex;
+}
+
+const char* ChainBuffer::peek() const {
+    return head_ == nullptr ? nullptr : head_->data + head_->readIndex;
+}
+
+void ChainBuffer::retrieve(size_t len) {
+    assert(len <= readable_);
+    readable_ -= len;
+    while (len > 0) {
+        size_t n = std::min(len, head_->writeIndex - head_->readIndex);
+        head_->readIndex += n;
+        len -= n;
+        if (head_->readIndex == head_->writeIndex) {
+            popBlock();
+        }
+    }
+}
+
+void ChainBuffer::retrieveAll() {
+    while (head_ != nullptr) {
+        popBlock();
+    }
+    readable_ = 0;
+}
+
+std::string ChainBuffer::retrieveAsString(size_t len) {
+    assert(len <= readable_);
+    std::string result(len, '\0');
+    copyOut(result.data(), len);
+    retrieve(len);
+    return result;
+}
+
+void ChainBuffer::append(const char* data, size_t len) {
+    readable_ += len;
+    while (len > 0) {
+        if (tail_ == nullptr || tail_->writeIndex == kBlockSize) {
+            pushBlock(newBlock());
+        }
+        size_t n = std::min(len, kBlockSize - tail_->writeIndex);
+        std::memcpy(tail_->data + tail_->writeIndex, data, n);
+        tail_->writeIndex += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::copyOut(void* dst, size_t len) const {
+    assert(len <= readable_);
+    char* out = static_cast<char*>(dst);
+    for (Block* block = head_; len > 0; block = block->next) {
+        size_t n = std::min(len, block->writeIndex - block->readIndex);
+        std::memcpy(out, block->data + block->readIndex, n);
+        out += n;
+        len -= n;
+    }
+}
+
+int ChainBuffer::fillIovec(struct iovec* vec, int maxCount) const {
+    int count = 0;
+    for (Block* block = head_; block != nullptr && count < maxCount; block = block->next) {
+        vec[count].iov_base = block->data + block->readIndex;
+        vec[count].iov_len = block->writeIndex - block->readIndex;
+        ++count;
+    }
+    return count;
+}
+
+ssize_t ChainBuffer::readFd(int fd, int* savedErrno) {
+    // 尾块剩余的空间加一个新块，新块没有用到时留作空闲块
+    Block* block = newBlock();
+    struct iovec vec[2];
+    int iovcnt = 0;
+    size_t writable = 0;
+    if (tail_ != nullptr && tail_->writeIndex < kBlockSize) {
+        writable = kBlockSize - tail_->writeIndex;
+        vec[iovcnt].iov_base = tail_->data + tail_->writeIndex;
+        vec[iovcnt].iov_len = writable;
+        ++iovcnt;
+    }
+    vec[iovcnt].iov_base = block->data;
+    vec[iovcnt].iov_len = kBlockSize;
+    ++iovcnt;
+
+    ssize_t n = ::readv(fd, vec, iovcnt);
+    if (n < 0) {
+        *savedErrno = errno;
+        freeBlock(block);
+        return n;
+    }
+    size_t len = static_cast<size_t>(n);
+    readable_ += len;
+    if (len <= writable) {
+        tail_->writeIndex += len;
+        freeBlock(block);
+    }
+    else {
+        if (writable > 0) {
+            tail_->writeIndex = kBlockSize;
+        }
+        block->writeIndex = len - writable;
+        pushBlock(block);
+    }
+    return n;
+}
+
+ssize_t ChainBuffer::writeFd(int fd, int* savedErrno, size_t maxBytes) {
+    struct iovec vec[IOV_MAX];
+    int iovcnt = fillIovec(vec, IOV_MAX);
+    // 截断到maxBytes
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        if (vec[i].iov_len >= maxBytes - total) {
+            vec[i].iov_len = maxBytes - total;
+            iovcnt = i + 1;
+            break;
+        }
+        total += vec[i].iov_len;
+    }
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0) {
+        *savedErrno = errno;
+        return n;
+    }
+    retrieve(static_cast<size_t>(n));
+    return n;
+}
+
+void ChainBuffer::release() {
+    retrieveAll();
+    if (spare_ != nullptr) {
+        deleteBlock(spare_);
+        spare_ = nullptr;
+    }
+    assert(blocks_ == 0);
+}
+
+size_t ChainBuffer::internalCapacity() const {
+    return blocks_ * kBlockSize;
+}
+
+ChainBuffer::Block* ChainBuffer::newBlock() {
+    Block* block = spare_;
+    if (block != nullptr) {
+        spare_ = nullptr;
+    }
+    else {
+        static_assert(sizeof(Block) == kBlockBytes, "block should fill a pool class exactly");
+        if (poolUsable()) {
+            size_t capacity;
+            block = static_cast<Block*>(pool_->allocate(sizeof(Block), &capacity));
+            assert(capacity == sizeof(Block));
+            block->pooled = true;
+        }
+        else {
+            block = static_cast<Block*>(::operator new(sizeof(Block)));
+            block->pooled = false;
+        }
+        ++blocks_;
+    }
+    block->next = nullptr;
+    block->readIndex = 0;
+    block->writeIndex = 0;
+    return block;
+}
+
+void ChainBuffer::freeBlock(Block* block) {
+    if (spare_ == nullptr) {
+        spare_ = block;
+    }
+    else deleteBlock(block);
+}
+
+void ChainBuffer::deleteBlock(Block* block) {
+    // 池允许其他线程归还块
+    if (block->pooled) {
+        pool_->deallocate(block, sizeof(Block));
+    }
+    else ::operator delete(block);
+    --blocks_;
+}
+
+void ChainBuffer::pushBlock(Block* block) {
+    if (tail_ == nullptr) {
+        head_ = block;
+    }
+    else {
+        tail_->next = block;
+    }
+    tail_ = block;
+}
+
+void ChainBuffer::popBlock() {
+    Block* block = head_;
+    head_ = block->next;
+    if (head_ == nullptr) {
+        tail_ = nullptr;
+    }
+    freeBlock(block);
+}
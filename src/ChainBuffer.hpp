@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+#include "noncopyable.hpp"
+
+struct iovec;
+
+namespace mudong {
+
+namespace ev {
+
+class BufferPool;
+
+/**
+ * 由固定大小的块串成的缓冲区，接口与Buffer保持一致（peek、retrieve、append、readInt32等）。
+ * 追加只写入尾块并按需挂上新块，取出只移动头块的读下标并释放读完的块，增长时不会搬移已有数据，
+ * 适合慢速对端堆积大量待发送数据的outputBuffer_。数据可能跨越多个块，因此peek()只返回头块中
+ * 连续的contiguousBytes()字节，跨块读取整数时逐段拷贝；收发用readv/writev直接在块上进行。
+ * 最多缓存一个空闲块，避免在一个块的边界上反复分配与释放；空的ChainBuffer不占用堆内存
+**/
+class ChainBuffer : noncopyable {
+
+public:
+    // 每个块连同块头正好占16KB，可以整块从BufferPool中分配；kBlockSize为块中数据的容量
+    static const size_t kBlockBytes = 16 * 1024;
+    static const size_t kBlockSize = kBlockBytes - 4 * sizeof(size_t);
+
+    ChainBuffer();
+    ~ChainBuffer();
+
+    ChainBuffer(ChainBuffer&& rhs) noexcept;
+    ChainBuffer& operator=(ChainBuffer&& rhs) noexcept;
+
+    void swap(ChainBuffer& rhs) noexcept;
+
+    /**
+     * 之后的块从pool中分配，只能在还没有分配任何块时调用。与Buffer一样持有池的引用，可以在任意线程中析构；
+     * 被移到其他线程后新的块改用全局分配器，每个块记录自己的来源，释放时各回各处
+    **/
+    void setPool(std::shared_ptr<BufferPool> pool);
+    const std::shared_ptr<BufferPool>& pool() const {
+        return pool_;
+    }
+
+    size_t readableBytes() const {
+        return readable_;
+    }
+    // 头块中连续可读的字节数
+    size_t contiguousBytes() const;
+    const char* peek() const;
+
+    void retrieve(size_t len);
+    void retrieveAll();
+    std::string retrieveAsString(size_t len);
+    std::string retrieveAllAsString() {
+        return retrieveAsString(readableBytes());
+    }
+
+    void retrieveInt64() { retrieve(sizeof(int64_t)); }
+    void retrieveInt32() { retrieve(sizeof(int32_t)); }
+    void retrieveInt16() { retrieve(sizeof(int16_t)); }
+    void retrieveInt8() { retrieve(sizeof(int8_t)); }
+
+    void append(const char* data, size_t len);
+    void append(const void* data, size_t len) {
+        append(static_cast<const char*>(data), len);
+    }
+    void append(std::string_view data) {
+        append(data.data(), data.length());
+    }
+
+    void appendInt64(int64_t x) {
+        int64_t be64 = static_cast<int64_t>(htobe64(static_cast<uint64_t>(x)));
+        append(&be64, sizeof be64);
+    }
+    void appendInt32(int32_t x) {
+        int32_t be32 = static_cast<int32_t>(htobe32(static_cast<uint32_t>(x)));
+        append(&be32, sizeof be32);
+    }
+    void appendInt16(int16_t x) {
+        int16_t be16 = static_cast<int16_t>(htobe16(static_cast<uint16_t>(x)));
+        append(&be16, sizeof be16);
+    }
+    void appendInt8(int8_t x) {
+        append(&x, sizeof x);
+    }
+
+    int64_t peekInt64() const {
+        int64_t be64 = 0;
+        copyOut(&be64, sizeof be64);
+        return static_cast<int64_t>(be64toh(static_cast<uint64_t>(be64)));
+    }
+    int32_t peekInt32() const {
+        int32_t be32 = 0;
+        copyOut(&be32, sizeof be32);
+        return static_cast<int32_t>(be32toh(static_cast<uint32_t>(be32)));
+    }
+    int16_t peekInt16() const {
+        int16_t be16 = 0;
+        copyOut(&be16, sizeof be16);
+        return static_cast<int16_t>(be16toh(static_cast<uint16_t>(be16)));
+    }
+    int8_t peekInt8() const {
+        int8_t x = 0;
+        copyOut(&x, sizeof x);
+        return x;
+    }
+
+    int64_t readInt64() {
+        int64_t result = peekInt64();
+        retrieveInt64();
+        return result;
+    }
+    int32_t readInt32() {
+        int32_t result = peekInt32();
+        retrieveInt32();
+        return result;
+    }
+    int16_t readInt16() {
+        int16_t result = peekInt16();
+        retrieveInt16();
+        return result;
+    }
+    int8_t readInt8() {
+        int8_t result = peekInt8();
+        retrieveInt8();
+        return result;
+    }
+
+    // 从头部拷贝len个字节到dst，不移动读位置
+    void copyOut(void* dst, size_t len) const;
+
+    // 用可读数据填充vec，最多maxCount段，返回填充的段数
+    int fillIovec(struct iovec* vec, int maxCount) const;
+
+    // readv读入尾块的剩余空间与一个新块
+    ssize_t readFd(int fd, int* savedErrno);
+    // writev写出尽可能多的数据（最多maxBytes字节），并取出已写出的部分
+    ssize_t writeFd(int fd, int* savedErrno, size_t maxBytes = SIZE_MAX);
+
+    // 丢弃数据并释放所有块（包括缓存的空闲块）
+    void release();
+    // 已分配的块占用的数据空间
+    size_t internalCapacity() const;
+
+private:
+    struct Block {
+        Block* next;
+        // 是否从pool_中分配
+        bool pooled;
+        size_t readIndex;
+        size_t writeIndex;
+        char data[kBlockSize];
+    };
+
+    // 只有在池所属的线程中才能从pool_分配
+    bool poolUsable() const;
+    Block* newBlock();
+    // 头块或读完的块先留作空闲块，已有空闲块时才真正释放
+    void freeBlock(Block* block);
+    void deleteBlock(Block* block);
+    void pushBlock(Block* block);
+    // 释放已经读完的头块
+    void popBlock();
+
+    Block* head_;
+    Block* tail_;
+    Block* spare_;
+    size_t readable_;
+    size_t blocks_;
+    // 仍有块来自pool_时必须保持非空
+    std::shared_ptr<BufferPool> pool_;
+};
+
+} // namespace ev
+
+} // namespace mudong
@@ -9,30 +9,24 @@
 using namespace mudong::ev;
 
 Channel::Channel(EventLoop* loop, int fd) :
-            pooling(false),
             loop_(loop),
+            handlers_(nullptr),
+            owner_(nullptr),
             fd_(fd),
-            tied_(false),
             events_(0),
             revents_(0),
-            handlingEvents_(false)
+            edgeTriggered_(false),
+            handlingEvents_(false),
+            pooling(false)
 {}
 
 Channel::~Channel() {
     assert(!handlingEvents_ && "handling Events while Channel destructing");
 }
 
-void Channel::setReadCallback(const ReadCallback& callback) {
-    readCallback_ = callback;
-}
-void Channel::setWriteCallback(const WriteCallback& callback) {
-    writeCallback_ = callback;
-}
-void Channel::setCloseCallback(const CloseCallback& callback) {
-    closeCallback_ = callback;
-}
-void Channel::setErrorCallback(const ErrorCallback& callback) {
-    errorCallback_ = callback;
+void Channel::setHandlers(const Handlers* handlers, void* owner) {
+    handlers_ = handlers;
+    owner_ = owner;
 }
 
 void Channel::handleEvents() {
@@ -41,12 +35,12 @@ void Channel::handleEvents() {
      * Channel总是作为另一个对象的成员，比如Timer、Acceptor、TCPConnection
      * TCPConnection用shared_ptr来管理，当使用TCPConnect中的Channel对象，
      * 调用其相关方法时，TcpConnect可能提前执行析构，这种内存释放顺序是错误的，
-     * 因此使用weak_ptr来延长对象的生命周期，相当于上了个锁，Channel执行完
+     * 因此由Handlers::guard取得一个shared_ptr来延长对象的生命周期，相当于上了个锁，Channel执行完
      * 其母对象才能执行析构流程
     **/
-    
-    if (tied_) {
-        auto guard = tie_.lock();
+    assert(handlers_ != nullptr);
+    if (handlers_->guard != nullptr) {
+        auto guard = handlers_->guard(owner_);
         if (guard != nullptr) {
             handleEventWithGuard();
         }
@@ -60,15 +54,12 @@ bool Channel::isNoneEvents() const {
     return events_ == 0;
 }
 unsigned Channel::events() const {
-    return events_;
+    // EPOLLET只是注册方式，不计入关注的事件，否则isNoneEvents()会失效
+    return events_ != 0 && edgeTriggered_ ? events_ | EPOLLET : events_;
 }
 void Channel::setRevents(unsigned revents) {
     revents_ = revents;
 }
-void Channel::tie(const std::shared_ptr<void>& rhs) {
-    tie_ = rhs;
-    tied_ = true;
-}
 
 void Channel::enableRead() {
     events_ |= (EPOLLIN | EPOLLPRI);
@@ -91,6 +82,10 @@ void Channel::disableAll() {
     update();
 }
 
+void Channel::setEdgeTriggered(bool on) {
+    edgeTriggered_ = on;
+}
+
 bool Channel::isReading() const {
     return events_ & EPOLLIN;
 }
@@ -108,18 +103,18 @@ void Channel::remove() {
 
 void Channel::handleEventWithGuard() {
     handlingEvents_ = true;
-    // 调用前都要判断回调函数已注册
+    // 调用前都要判断处理函数已注册
     if ((revents_ & EPOLLHUP) && !(revents_ & EPOLLIN)) {
-        if (closeCallback_) closeCallback_();
+        if (handlers_->close) handlers_->close(owner_);
     }
     if (revents_ & EPOLLERR) {
-        if (errorCallback_) errorCallback_();
+        if (handlers_->error) handlers_->error(owner_);
     }
     if (revents_ & (EPOLLIN | EPOLLPRI | EPOLLRDHUP)) {
-        if (readCallback_) readCallback_();
+        if (handlers_->read) handlers_->read(owner_);
     }
     if (revents_ & EPOLLOUT) {
-        if (writeCallback_) writeCallback_();
+        if (handlers_->write) handlers_->write(owner_);
     }
     handlingEvents_ = false;
 }
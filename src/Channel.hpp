@@ -2,7 +2,6 @@
 
 #include "noncopyable.hpp"
 
-#include <functional>
 #include <memory>
 
 
@@ -14,21 +13,26 @@ class EventLoop;
 
 class Channel : noncopyable {
 
-private:
-    using ReadCallback  = std::function<void()>;
-    using WriteCallback = std::function<void()>;
-    using CloseCallback = std::function<void()>;
-    using ErrorCallback = std::function<void()>;
-
 public:
+    /**
+     * 同一类拥有者（Acceptor、TimerQueue、TcpConnection等）共享的只读事件处理表，通常定义为拥有者的静态成员。
+     * Channel只保存表的指针与拥有者指针，取代原先每个Channel四个std::function加一个weak_ptr的开销，
+     * 未注册的事件对应的表项为nullptr
+    **/
+    struct Handlers {
+        void (*read)(void* owner);
+        void (*write)(void* owner);
+        void (*close)(void* owner);
+        void (*error)(void* owner);
+        // 非空时在处理事件前取得拥有者的引用，拥有者已经析构则忽略本次事件，取代原先的tie
+        std::shared_ptr<void> (*guard)(void* owner);
+    };
+
     Channel(EventLoop* loop, int fd);
     ~Channel();
 
 public:
-    void setReadCallback(const ReadCallback& callback);
-    void setWriteCallback(const WriteCallback& callback);
-    void setCloseCallback(const CloseCallback& callback);
-    void setErrorCallback(const ErrorCallback& callback);
+    void setHandlers(const Handlers* handlers, void* owner);
 
     // TODO
     void handleEvents();
@@ -36,33 +40,31 @@ public:
     bool isNoneEvents() const;
     unsigned events() const;
     void setRevents(unsigned);
-    void tie(const std::shared_ptr<void>& obj);
 
     void enableRead();
     void enableWrite();
     void disableRead();
     void disableWrite();
     void disableAll();
+    // 以EPOLLET注册，下一次update时生效
+    void setEdgeTriggered(bool on);
 
     bool isReading() const;
     bool isWriting() const;
 
-public:
-    bool pooling;
-
 private:
+    // 按大小排列，与pooling一起放在末尾，避免填充
     EventLoop* loop_;
+    const Handlers* handlers_;
+    void* owner_;
     int fd_;
-    std::weak_ptr<void> tie_;
-    bool tied_;
     unsigned events_;
     unsigned revents_;
+    bool edgeTriggered_;
     bool handlingEvents_;
 
-    ReadCallback readCallback_;
-    WriteCallback writeCallback_;
-    CloseCallback closeCallback_;
-    ErrorCallback errorCallback_;
+public:
+    bool pooling;
 
 private:
     // TODO
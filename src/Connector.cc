@@ -16,6 +16,14 @@ int createSocket() {
 
 } // namespace anonymous
 
+const Channel::Handlers Connector::kChannelHandlers = {
+    nullptr,
+    [](void* owner) { static_cast<Connector*>(owner)->handleWrite(); },
+    nullptr,
+    nullptr,
+    nullptr
+};
+
 Connector::Connector(EventLoop* loop, const InetAddress& peer)
         : loop_(loop),
           peer_(peer),
@@ -24,7 +32,7 @@ Connector::Connector(EventLoop* loop, const InetAddress& peer)
           started_(false),
           channel_(loop, sockfd_)
 {
-    channel_.setWriteCallback([this](){handleWrite();});
+    channel_.setHandlers(&kChannelHandlers, this);
 }
 
 Connector::~Connector() {
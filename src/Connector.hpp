@@ -24,6 +24,8 @@ public:
     void setErrorCallback(const ErrorCallback& callback);
 
 private:
+    static const Channel::Handlers kChannelHandlers;
+
     void handleWrite();
 
     EventLoop* loop_;
@@ -1,11 +1,28 @@
+#include <atomic>
+#include <sys/syscall.h>
+
 #include "EPollPoller.hpp"
 #include "Logger.hpp"
 #include "EventLoop.hpp"
 
 using namespace mudong::ev;
 
+namespace {
+
+// epoll_pwait2（Linux 5.11）接受timespec超时，直接走系统调用以免依赖新版glibc
+std::atomic_bool epollPwait2Supported(true);
+
+int epollPwait2(int epfd, epoll_event* events, int maxEvents, Nanoseconds timeout) {
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(timeout.count() / std::nano::den);
+    ts.tv_nsec = timeout.count() % std::nano::den;
+    return static_cast<int>(::syscall(__NR_epoll_pwait2, epfd, events, maxEvents, &ts, nullptr, 0));
+}
+
+} // anonymous namespace
+
 EPollPoller::EPollPoller(EventLoop* loop)
-        : loop_(loop),
+        : Poller(loop, Type::kEPoll),
           events_(128),
           epollfd_(epoll_create1(EPOLL_CLOEXEC))
 {
@@ -17,11 +34,28 @@ EPollPoller::~EPollPoller() {
     close(epollfd_);
 }
 
-void EPollPoller::poll(ChannelList& activeChannels) {
+void EPollPoller::poll(ChannelList& activeChannels, Nanoseconds timeout) {
     loop_->assertInLoopThread();
     int maxEvents = static_cast<int>(events_.size());
-    // 得到触发的event个数，并将epoll_event写入events_缓冲区，最多一次获取128个(初始参数，可调)
-    int nEvents = epoll_wait(epollfd_, events_.data(), maxEvents, -1);
+    int nEvents = -1;
+    bool waited = false;
+    if (preciseTimeout_ && timeout > Nanoseconds::zero() && epollPwait2Supported.load(std::memory_order_relaxed)) {
+        nEvents = epollPwait2(epollfd_, events_.data(), maxEvents, timeout);
+        waited = nEvents != -1 || errno != ENOSYS;
+        if (!waited) {
+            epollPwait2Supported.store(false, std::memory_order_relaxed);
+            WARN("EPollPoller::poll epoll_pwait2 unsupported, timeout rounds up to milliseconds");
+        }
+    }
+    if (!waited) {
+        int timeoutMs = -1;
+        if (timeout >= Nanoseconds::zero()) {
+            // 向上取整到毫秒，避免在到期前提前返回导致空转
+            timeoutMs = static_cast<int>(std::chrono::ceil<Milliseconds>(timeout).count());
+        }
+        // 得到触发的event个数，并将epoll_event写入events_缓冲区，最多一次获取128个(初始参数，可调)
+        nEvents = epoll_wait(epollfd_, events_.data(), maxEvents, timeoutMs);
+    }
     if (nEvents == -1) {
         if (errno != EINTR) { // signal: interrupted sys call
             SYSERR("EPollPoller::epoll_wait");
@@ -41,6 +75,10 @@ void EPollPoller::poll(ChannelList& activeChannels) {
     }
 }
 
+bool EPollPoller::supportsEdgeTriggered() const {
+    return true;
+}
+
 void EPollPoller::updateChannel(Channel* channel) {
     loop_->assertInLoopThread();
     int op = 0;
@@ -57,10 +95,10 @@ void EPollPoller::updateChannel(Channel* channel) {
         op = EPOLL_CTL_DEL;
         channel->pooling = false;
     }
-    updateChannel(op, channel);
+    update(op, channel);
 }
 
-void EPollPoller::updateChannel(int op, Channel* channel) {
+void EPollPoller::update(int op, Channel* channel) {
     epoll_event epEv;
     epEv.events = channel->events();
     // 在注册事件的时候，附带上了Channel指针，因此epoll_wait得到的event中包含了
@@ -3,29 +3,24 @@
 #include <vector>
 #include <sys/epoll.h>
 
-#include "noncopyable.hpp"
+#include "Poller.hpp"
 
 namespace mudong {
 
 namespace ev {
 
-class EventLoop;
-class Channel;
-
-class EPollPoller: noncopyable {
+class EPollPoller: public Poller {
 
 public:
-    using ChannelList = std::vector<Channel*>;
-
     explicit EPollPoller(EventLoop* loop);
-    ~EPollPoller();
+    ~EPollPoller() override;
 
-    void poll(ChannelList& activeChannels);
-    void updateChannel(Channel* channel);
+    void poll(ChannelList& activeChannels, Nanoseconds timeout) override;
+    void updateChannel(Channel* channel) override;
+    bool supportsEdgeTriggered() const override;
 
 private:
-    void updateChannel(int op, Channel* channel);
-    EventLoop* loop_;
+    void update(int op, Channel* channel);
     std::vector<epoll_event> events_;
     int epollfd_;
 
@@ -33,4 +28,4 @@ private:
 
 } // namespace ev
 
-} // namespace mudong
\ No newline at end of file
+} // namespace mudong
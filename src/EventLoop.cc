@@ -1,6 +1,10 @@
 #include <syscall.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
 
 #include "EventLoop.hpp"
 #include "Logger.hpp"
@@ -10,11 +14,29 @@ using namespace mudong::ev;
 namespace {
 
 __thread EventLoop* t_Eventloop = nullptr; // thread local variable
+__thread pid_t t_cachedTid = 0;
 
+// 线程id在线程的生命周期内不变，缓存下来避免isInLoopThread每次都进行系统调用
 pid_t internalGettid() {
-    return static_cast<pid_t>(syscall(SYS_gettid));
+    if (t_cachedTid == 0) {
+        t_cachedTid = static_cast<pid_t>(syscall(SYS_gettid));
+    }
+    return t_cachedTid;
+}
+
+// fork出的子进程中只有调用fork的线程，其tid与父进程不同，需要丢弃继承来的缓存
+void afterFork() {
+    t_cachedTid = 0;
 }
 
+class ResetTidAfterFork {
+public:
+    ResetTidAfterFork() {
+        pthread_atfork(nullptr, nullptr, &afterFork);
+    }
+};
+ResetTidAfterFork resetTidAfterFork;
+
 /*
 当进程尝试向一个已经关闭写端的管道或套接字（例如，在网络通信中对方已经关闭连接）发送数据时。
 默认情况下，如果程序没有处理该信号，操作系统会终止进程，这可能导致不希望的结果。
@@ -31,21 +53,44 @@ IgnoreSigPipe ignore;
 
 } // anonymous namespace
 
-EventLoop::EventLoop()
+const Channel::Handlers EventLoop::kChannelHandlers = {
+    [](void* owner) { static_cast<EventLoop*>(owner)->handleRead(); },
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
+
+EventLoop::EventLoop(Poller::Type pollerType)
         : tid_(internalGettid()),
           quit_(false),
           doingPendingTasks_(false),
-          poller_(this),
+          poller_(Poller::newPoller(this, pollerType)),
+          now_(clock::now()),
+          spinBudget_(Nanoseconds::zero()),
+          socketBusyPollUs_(0),
+          spinNanos_(0),
+          blockedNanos_(0),
           wakeupfd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
           wakeupChannel_(this, wakeupfd_),
-          timerQueue_(this)
+          wakeupPending_(false),
+          wakeupsWritten_(0),
+          wakeupsSaved_(0),
+          corkedSends_(0),
+          corkedWrites_(0),
+          queuedOutputBytes_(0),
+          pendingTasks_(kReservedTasks),
+          doingAfterIterationTasks_(false),
+          timerQueue_(this),
+          bufferPool_(std::make_shared<BufferPool>()),
+          readBuffer_(kReadBufferSize)
 {
     // 检查用于事件通知的文件描述符是否被正确创建
     if (wakeupfd_ == -1) {
         SYSFATAL("EventLoop::eventfd");
     }
 
-    wakeupChannel_.setReadCallback([this](){handleRead();});
+    wakeupChannel_.setHandlers(&kChannelHandlers, this);
     wakeupChannel_.enableRead();
 
     assert(t_Eventloop == nullptr);
@@ -55,22 +100,28 @@ EventLoop::EventLoop()
 EventLoop::~EventLoop() {
     wakeupChannel_.disableAll(); // 移除对wakeupChannel_的监听
     close(wakeupfd_); // 释放资源
+    bufferPool_->detach(); // 还存活的连接持有池的引用，之后的释放都交给池自己回收
     assert(t_Eventloop == this);
     t_Eventloop = nullptr;
 }
 
 void EventLoop::loop() {
     assertInLoopThread();
-    TRACE("EventLoop {} start polling", static_cast<void*>(this));
+    TRACE("EventLoop {} start polling with {}", static_cast<void*>(this), Poller::typeName(poller_->type()));
     quit_ = false;
     while (!quit_) {
         activeChannels_.clear();
-        poller_.poll(activeChannels_); // 得到触发的event，装载入activeChannels_中
+        poll(); // 得到触发的event，装载入activeChannels_中
+        now_ = clock::now(); // 本轮中的回调与定时器操作共用这一次读取的时间
         for (auto channelPtr : activeChannels_) {
             channelPtr->handleEvents();
         }
+        if (timerQueue_.mode() == TimerQueue::Mode::kPollTimeout) {
+            timerQueue_.runExpired(); // poll按最近的到期时刻超时返回，在这里直接执行到期的定时器
+        }
         // 这里的关键是如何使得线程不会被阻塞在epoll_wait，而能顺利执行后续任务，wakeup()
         doPendingTasks();
+        doAfterIterationTasks();
     }
     TRACE("EventLoop {} quit", static_cast<void*>(this));
 }
@@ -83,61 +134,63 @@ void EventLoop::quit() {
     }
 }
 
-void EventLoop::runInLoop(const Task& task) {
-    if (isInLoopThread()) {
-        task();
-    }
-    else queueInLoop(task);
-}
-
-void EventLoop::runInLoop(Task&& task) {
-    if (isInLoopThread()) {
-        task();
-    }
-    else queueInLoop(std::move(task));
-}
-
-void EventLoop::queueInLoop(const Task& task) {
-    {
-        std::lock_guard<std::mutex> guard(mutex_);
-        pendingTasks_.push_back(task);
-    }
+void EventLoop::queueInLoop(Task task) {
+    pendingTasks_.push(std::move(task));
     // 如果不在循环线程，就唤醒循环线程去处理任务；如果在循环线程，并且正在处理任务，那么同样唤醒
-    if (!isInLoopThread() || doingPendingTasks_) {
+    if (!isInLoopThread() || doingPendingTasks_ || doingAfterIterationTasks_) {
         wakeup();
     }
 }
 
-void EventLoop:: queueInLoop(Task&& task) {
-    {
-        std::lock_guard<std::mutex> guard(mutex_);
-        pendingTasks_.push_back(std::move(task));
-    }
-    if (!isInLoopThread() || doingPendingTasks_) {
+void EventLoop::runAfterIteration(Task task) {
+    assertInLoopThread();
+    afterIterationTasks_.push_back(std::move(task));
+    // 本轮的这些任务已经在执行了，新登记的任务要等下一轮，不能让下一次poll阻塞
+    if (doingAfterIterationTasks_) {
         wakeup();
     }
 }
 
-Timer* EventLoop::runAt(Timestamp when, TimerCallback callback) {
+Timestamp EventLoop::now() const {
+    return t_Eventloop == this ? now_ : clock::now();
+}
+
+TimerId EventLoop::runAt(Timestamp when, TimerCallback callback) {
     // 添加一个定时器
     return timerQueue_.addTimer(std::move(callback), when, Milliseconds::zero());
 }
 
-Timer* EventLoop::runAfter(Nanoseconds interval, TimerCallback callback) {
-    return runAt(clock::now() + interval, std::move(callback));
+TimerId EventLoop::runAfter(Nanoseconds interval, TimerCallback callback) {
+    return runAt(now() + interval, std::move(callback));
 }
 
 //每隔interval长度的时间触发一次
-Timer* EventLoop::runEvery(Nanoseconds interval, TimerCallback callback) {
-    return timerQueue_.addTimer(std::move(callback), clock::now() + interval, interval);
+TimerId EventLoop::runEvery(Nanoseconds interval, TimerCallback callback) {
+    return timerQueue_.addTimer(std::move(callback), now() + interval, interval);
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+    timerQueue_.cancelTimer(id);
+}
+
+void EventLoop::setTimerEngine(TimerEngine::Type type) {
+    timerQueue_.setEngine(type);
 }
 
-void EventLoop::cancelTimer(Timer* timer) {
-    timerQueue_.cancelTimer(timer);
+void EventLoop::setTimerMode(TimerQueue::Mode mode, bool precise) {
+    assertInLoopThread();
+    poller_->setPreciseTimeout(precise && mode == TimerQueue::Mode::kPollTimeout);
+    timerQueue_.setMode(mode, precise);
 }
 
 // 写入一个数，有了事件，接触loop中的epoll_wait阻塞
 void EventLoop::wakeup() {
+    // 在loop清除标志之前，eventfd上已有未处理的唤醒，本次写入是多余的
+    if (wakeupPending_.exchange(true)) {
+        wakeupsSaved_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    wakeupsWritten_.fetch_add(1, std::memory_order_relaxed);
     uint64_t one = 1;
     ssize_t n = write(wakeupfd_, &one, sizeof(one));
     if (n != sizeof(one)) {
@@ -145,9 +198,45 @@ void EventLoop::wakeup() {
     }
 }
 
+uint64_t EventLoop::wakeupsWritten() const {
+    return wakeupsWritten_.load(std::memory_order_relaxed);
+}
+
+uint64_t EventLoop::wakeupsSaved() const {
+    return wakeupsSaved_.load(std::memory_order_relaxed);
+}
+
+void EventLoop::countCorkedSend() {
+    corkedSends_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void EventLoop::countCorkedWrite() {
+    corkedWrites_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t EventLoop::corkedSends() const {
+    return corkedSends_.load(std::memory_order_relaxed);
+}
+
+uint64_t EventLoop::corkedWrites() const {
+    return corkedWrites_.load(std::memory_order_relaxed);
+}
+
+void EventLoop::addQueuedOutput(size_t bytes) {
+    queuedOutputBytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void EventLoop::removeQueuedOutput(size_t bytes) {
+    queuedOutputBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+size_t EventLoop::queuedOutputBytes() const {
+    return queuedOutputBytes_.load(std::memory_order_relaxed);
+}
+
 void EventLoop::updateChannel(Channel* channel) {
     assertInLoopThread();
-    poller_.updateChannel(channel);
+    poller_->updateChannel(channel);
 }
 
 void EventLoop::removeChannel(Channel* channel) {
@@ -167,18 +256,144 @@ bool EventLoop::isInLoopThread() {
     return tid_ == internalGettid();
 }
 
-void EventLoop::doPendingTasks() {
+Poller::Type EventLoop::pollerType() const {
+    return poller_->type();
+}
+
+bool EventLoop::supportsEdgeTriggered() const {
+    return poller_->supportsEdgeTriggered();
+}
+
+void EventLoop::setBusyPoll(Nanoseconds spinBudget, int socketBusyPollUs) {
     assertInLoopThread();
-    std::vector<Task> tasks;
-    {
-        std::lock_guard<std::mutex> guard(mutex_);
-        tasks.swap(pendingTasks_); // 将原队列对象置换出来，减少临界区范围
+    spinBudget_ = spinBudget;
+    if (socketBusyPollUs > 0) {
+        // 设置时用一个临时socket检查一次权限，失败则不再对每个accept的socket重复尝试
+        int probe = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe == -1 ||
+            setsockopt(probe, SOL_SOCKET, SO_BUSY_POLL, &socketBusyPollUs, sizeof(socketBusyPollUs)) == -1) {
+            SYSERR("EventLoop::setBusyPoll setsockopt SO_BUSY_POLL, disabled");
+            socketBusyPollUs = 0;
+        }
+        if (probe != -1) {
+            close(probe);
+        }
+    }
+    socketBusyPollUs_ = socketBusyPollUs;
+}
+
+int EventLoop::socketBusyPollUs() const {
+    return socketBusyPollUs_;
+}
+
+Nanoseconds EventLoop::spinTime() const {
+    return Nanoseconds(spinNanos_.load(std::memory_order_relaxed));
+}
+
+Nanoseconds EventLoop::blockedTime() const {
+    return Nanoseconds(blockedNanos_.load(std::memory_order_relaxed));
+}
+
+Buffer& EventLoop::readBuffer() {
+    assertInLoopThread();
+    assert(readBuffer_.readableBytes() == 0);
+    // 回调中被移走存储时（例如send(std::move(buffer))）重新分配
+    readBuffer_.ensureWritableBytes(kReadBufferSize);
+    return readBuffer_;
+}
+
+const std::shared_ptr<BufferPool>& EventLoop::bufferPool() const {
+    return bufferPool_;
+}
+
+void EventLoop::setFileCache(size_t capacity, Nanoseconds ttl) {
+    assertInLoopThread();
+    fileCache_ = std::make_unique<FileCache>(capacity, ttl);
+}
+
+FileCache* EventLoop::fileCache() {
+    return fileCache_.get();
+}
+
+void EventLoop::linger(std::function<bool()> drained, Nanoseconds timeout) {
+    assertInLoopThread();
+    lingering_.push_back(Lingering{now() + timeout, std::move(drained)});
+    if (lingering_.size() == 1) {
+        lingerTimer_ = runEvery(kLingerInterval, [this]() { checkLingering(); });
+    }
+}
+
+size_t EventLoop::lingering() const {
+    return lingering_.size();
+}
+
+void EventLoop::checkLingering() {
+    Timestamp current = now();
+    lingering_.erase(std::remove_if(lingering_.begin(), lingering_.end(), [current](Lingering& item) {
+        return item.drained() || current >= item.deadline;
+    }), lingering_.end());
+    if (lingering_.empty()) {
+        cancelTimer(lingerTimer_);
+        lingerTimer_ = TimerId();
+    }
+}
+
+void EventLoop::poll() {
+    // kTimerfd模式下为kPollForever
+    Nanoseconds timeout = timerQueue_.pollTimeout();
+    if (spinBudget_ <= Nanoseconds::zero()) {
+        poller_->poll(activeChannels_, timeout);
+        return;
+    }
+    // 先在预算时间内零超时轮询，有事件就直接返回，省去一次阻塞与调度唤醒；有定时器先到期时提前结束
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + spinBudget_;
+    if (timeout >= Nanoseconds::zero() && timeout < spinBudget_) {
+        deadline = start + timeout;
     }
+    auto now = start;
+    do {
+        poller_->poll(activeChannels_, Nanoseconds::zero());
+        now = std::chrono::steady_clock::now();
+    } while (activeChannels_.empty() && !quit_ && now < deadline);
+    spinNanos_.fetch_add((now - start).count(), std::memory_order_relaxed);
+    if (!activeChannels_.empty() || quit_) {
+        return;
+    }
+    poller_->poll(activeChannels_, timerQueue_.pollTimeout());
+    blockedNanos_.fetch_add((std::chrono::steady_clock::now() - now).count(), std::memory_order_relaxed);
+}
+
+void EventLoop::doPendingTasks() {
+    assertInLoopThread();
     doingPendingTasks_ = true;
+    /**
+     * 必须在取走队列之前清除唤醒标志：在此之后入队的生产者会看到标志为false并重新写eventfd；
+     * 在此之前入队的任务一定会被下面的drain取走。若在drain之后才清除，
+     * 期间入队的任务会因为跳过了唤醒而滞留在队列中
+    **/
+    wakeupPending_.exchange(false);
+    // 一次取走当前已入队的全部任务，生产者无需加锁
+    pendingTasks_.drain([](Task& task) { task(); });
+    doingPendingTasks_ = false;
+}
+
+void EventLoop::doAfterIterationTasks() {
+    if (afterIterationTasks_.empty()) {
+        return;
+    }
+    doingAfterIterationTasks_ = true;
+    std::vector<Task> tasks;
+    tasks.swap(afterIterationTasks_);
     for (auto& task : tasks) {
         task();
     }
-    doingPendingTasks_ = false;
+    // 没有新登记的任务时换回去，保留已分配的容量
+    tasks.clear();
+    if (afterIterationTasks_.empty()) {
+        afterIterationTasks_.swap(tasks);
+    }
+    doingAfterIterationTasks_ = false;
 }
 
 // 将唤醒用的写入uint64_t给消耗掉
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
+#include <vector>
 
 #include "Timer.hpp"
 #include "TimerQueue.hpp"
-#include "EPollPoller.hpp"
+#include "Poller.hpp"
+#include "MpscQueue.hpp"
+#include "Buffer.hpp"
+#include "BufferPool.hpp"
+#include "FileCache.hpp"
 
 namespace mudong {
 
@@ -13,7 +19,7 @@ namespace ev {
 class EventLoop: noncopyable {
 
 public:
-    EventLoop();
+    explicit EventLoop(Poller::Type pollerType = Poller::defaultType());
     ~EventLoop();
     
     // 开启循环
@@ -21,20 +27,52 @@ public:
     // 退出循环
     void quit();
 
-    // 在当前loop中执行
-    void runInLoop(const Task& task);
-    void runInLoop(Task&& task);
+    // 在当前loop中执行：已在loop线程中时直接调用func，不经过类型擦除；否则包装成Task入队
+    template <typename F>
+    void runInLoop(F&& func) {
+        if (isInLoopThread()) {
+            func();
+        }
+        else queueInLoop(Task(std::forward<F>(func)));
+    }
     // 把任务放入队列中，唤醒loop所在的线程执行task
-    void queueInLoop(const Task& task);
-    void queueInLoop(Task&& task);
+    void queueInLoop(Task task);
+    /**
+     * 在本轮的活跃Channel与pendingTasks都处理完之后、下一次poll之前执行task，只能在loop线程中调用。
+     * TcpConnection的合并写借此把一轮中的多次send合并成一次写
+    **/
+    void runAfterIteration(Task task);
 
-    Timer* runAt(Timestamp when, TimerCallback callback);
-    Timer* runAfter(Nanoseconds interval, TimerCallback callback);
-    Timer* runEvery(Nanoseconds interval, TimerCallback callback);
-    void cancelTimer(Timer* timer);
+    // loop线程中返回本轮poll返回时缓存的单调时钟时间，同一轮中多次调用不再读取时钟；在其它线程中调用时读取当前时间
+    Timestamp now() const;
 
-    // 通过wakeupfd_/wakeupChannel_唤醒loop所在的线程
+    TimerId runAt(Timestamp when, TimerCallback callback);
+    TimerId runAfter(Nanoseconds interval, TimerCallback callback);
+    TimerId runEvery(Nanoseconds interval, TimerCallback callback);
+    // 返回的TimerId在定时器触发或取消后失效，对失效的TimerId调用cancelTimer是安全的空操作
+    void cancelTimer(TimerId id);
+    // 选择定时器引擎：有序集合（默认）或分层时间轮，已有的定时器会被迁移
+    void setTimerEngine(TimerEngine::Type type);
+    /**
+     * 选择定时器的驱动方式：timerfd（默认），或把最近的到期时刻作为poll的超时、poll返回后直接执行到期的定时器。
+     * precise为true时到期时刻精确到亚毫秒级，epoll后端需要内核支持epoll_pwait2，否则仍按毫秒取整
+    **/
+    void setTimerMode(TimerQueue::Mode mode, bool precise = false);
+
+    // 通过wakeupfd_/wakeupChannel_唤醒loop所在的线程，已有唤醒在途时不再重复写eventfd
     void wakeup();
+    // 实际写eventfd的次数，以及因合并而省去的次数
+    uint64_t wakeupsWritten() const;
+    uint64_t wakeupsSaved() const;
+    // 合并写模式下的send次数与实际写socket的次数，二者之差即省去的系统调用
+    void countCorkedSend();
+    void countCorkedWrite();
+    uint64_t corkedSends() const;
+    uint64_t corkedWrites() const;
+    // 本loop上所有连接还没有写出的字节数，由TcpConnection在loop线程中增减，可以在任意线程中读取
+    void addQueuedOutput(size_t bytes);
+    void removeQueuedOutput(size_t bytes);
+    size_t queuedOutputBytes() const;
 
     void updateChannel(Channel* channel);
     void removeChannel(Channel* channel);
@@ -44,22 +82,97 @@ public:
     void assertNotInLoopThread();
     bool isInLoopThread();
 
+    Poller::Type pollerType() const;
+    bool supportsEdgeTriggered() const;
+
+    /**
+     * 混合忙轮询：每次阻塞等待之前，先以零超时反复poll，最多持续spinBudget，用CPU换取更低的唤醒延迟。
+     * socketBusyPollUs大于0时，该loop上accept的socket会设置SO_BUSY_POLL，设置时检查一次权限，
+     * 没有权限则记录错误并不再设置。spinBudget为0时关闭
+    **/
+    void setBusyPoll(Nanoseconds spinBudget, int socketBusyPollUs = 0);
+    int socketBusyPollUs() const;
+    // 忙轮询模式下，loop在空转与阻塞等待上分别花费的时间
+    Nanoseconds spinTime() const;
+    Nanoseconds blockedTime() const;
+
+    /**
+     * 本loop上所有连接共用的读缓冲区。连接没有未消费的数据时直接读入这里并交给消息回调，
+     * 回调没有消费完的部分才复制到连接自己的inputBuffer_，空闲连接因此不占用读缓冲区。
+     * 只能在loop线程中使用，每次用完都要清空
+    **/
+    Buffer& readBuffer();
+
+    // 本loop上连接的Buffer与ChainBuffer使用的内存池，可以在任意线程中读取统计
+    const std::shared_ptr<BufferPool>& bufferPool() const;
+
+    // 开启已打开文件的缓存，供TcpConnection::sendFile按路径发送时复用fd。只能在loop线程中调用
+    void setFileCache(size_t capacity, Nanoseconds ttl = Seconds(1));
+    // 没有开启时为nullptr
+    FileCache* fileCache();
+
+    /**
+     * 连接关闭后还要保留到内核用完为止的资源，例如还没有收到完成通知的零拷贝发送。
+     * loop每隔kLingerInterval调用一次drained，返回true或超过timeout之后丢弃它，资源随之释放。只能在loop线程中调用
+    **/
+    void linger(std::function<bool()> drained, Nanoseconds timeout);
+    // 还在等待释放的资源个数
+    size_t lingering() const;
+
 private:
+    static const size_t kReadBufferSize = 64 * 1024;
+    // 预先分配的任务节点数，跨线程投递的任务积压不超过这个数量时queueInLoop不分配内存
+    static const size_t kReservedTasks = 256;
+    static constexpr Nanoseconds kLingerInterval = Milliseconds(10);
+
+    struct Lingering {
+        Timestamp deadline;
+        std::function<bool()> drained;
+    };
+
+    // 等待事件，装载入activeChannels_
+    void poll();
     // 执行上层添加的任务
     void doPendingTasks();
+    // 执行runAfterIteration登记的任务
+    void doAfterIterationTasks();
+    // 丢弃已经释放完毕或者超时的lingering_，全部丢弃后停止检查
+    void checkLingering();
+    static const Channel::Handlers kChannelHandlers;
+
     // 与wakeupfd_/wakeupChannel_绑定的回调，构造EventLoop时绑定
     void handleRead();
     // EventLoop对象创建时所在的线程，用以判断当前EventLoop对象是否在自身所属的线程中
     const pid_t tid_;
     std::atomic_bool quit_;
     std::atomic_bool doingPendingTasks_;
-    EPollPoller poller_;
-    EPollPoller::ChannelList activeChannels_;
+    std::unique_ptr<Poller> poller_;
+    Poller::ChannelList activeChannels_;
+    // 每次poll返回后更新，只在loop线程中访问
+    Timestamp now_;
+    Nanoseconds spinBudget_;
+    int socketBusyPollUs_;
+    std::atomic_int64_t spinNanos_;
+    std::atomic_int64_t blockedNanos_;
     const int wakeupfd_;
     Channel wakeupChannel_;
-    std::mutex mutex_;
-    std::vector<Task> pendingTasks_;
+    std::atomic_bool wakeupPending_;
+    std::atomic_uint64_t wakeupsWritten_;
+    std::atomic_uint64_t wakeupsSaved_;
+    std::atomic_uint64_t corkedSends_;
+    std::atomic_uint64_t corkedWrites_;
+    std::atomic_size_t queuedOutputBytes_;
+    MpscQueue<Task> pendingTasks_;
+    // 只在loop线程中访问
+    std::vector<Task> afterIterationTasks_;
+    bool doingAfterIterationTasks_;
     TimerQueue timerQueue_;
+    std::shared_ptr<BufferPool> bufferPool_;
+    Buffer readBuffer_;
+    std::unique_ptr<FileCache> fileCache_;
+    // 只在loop线程中访问，非空时由lingerTimer_定期检查
+    std::vector<Lingering> lingering_;
+    TimerId lingerTimer_;
 };
 
 } // namespace ev
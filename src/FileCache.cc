@@ -0,0 +1,91 @@
+#include "FileCache.hpp"
+
+#include <cassert>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+
+FileHandlePtr FileHandle::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        int savedErrno = errno;
+        ::close(fd);
+        errno = savedErrno;
+        return nullptr;
+    }
+    return std::make_shared<FileHandle>(fd, static_cast<size_t>(st.st_size));
+}
+
+FileHandle::FileHandle(int fd, size_t size)
+        : fd_(fd),
+          size_(size)
+{
+    assert(fd_ >= 0);
+}
+
+FileHandle::~FileHandle() {
+    ::close(fd_);
+}
+
+int FileHandle::fd() const {
+    return fd_;
+}
+
+size_t FileHandle::size() const {
+    return size_;
+}
+
+FileCache::FileCache(size_t capacity, Nanoseconds ttl)
+        : capacity_(capacity),
+          ttl_(ttl),
+          hits_(0),
+          misses_(0)
+{
+    assert(capacity_ > 0);
+}
+
+FileHandlePtr FileCache::open(const std::string& path, Timestamp now) {
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        auto entry = it->second;
+        if (now - entry->opened < ttl_) {
+            ++hits_;
+            entries_.splice(entries_.begin(), entries_, entry);
+            return entry->file;
+        }
+        // 过期的项重新打开
+        index_.erase(it);
+        entries_.erase(entry);
+    }
+
+    ++misses_;
+    FileHandlePtr file = FileHandle::open(path);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    if (entries_.size() == capacity_) {
+        index_.erase(entries_.back().path);
+        entries_.pop_back();
+    }
+    entries_.push_front(Entry{path, file, now});
+    index_.emplace(path, entries_.begin());
+    return file;
+}
+
+size_t FileCache::size() const {
+    return entries_.size();
+}
+
+uint64_t FileCache::hits() const {
+    return hits_;
+}
+
+uint64_t FileCache::misses() const {
+    return misses_;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "noncopyable.hpp"
+#include "Timestamp.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+// 只读打开的文件，析构时关闭fd。sendFile排队期间由TcpConnection持有引用
+class FileHandle : noncopyable {
+
+public:
+    // 打开失败返回nullptr，errno保留open/fstat的错误
+    static std::shared_ptr<FileHandle> open(const std::string& path);
+
+    // 接管fd的所有权
+    FileHandle(int fd, size_t size);
+    ~FileHandle();
+
+    int fd() const;
+    // 打开时的文件大小
+    size_t size() const;
+
+private:
+    const int fd_;
+    const size_t size_;
+};
+
+using FileHandlePtr = std::shared_ptr<FileHandle>;
+
+/**
+ * 每个EventLoop可选的已打开文件缓存，按路径保存最近使用的capacity个FileHandle，LRU淘汰。
+ * 缓存项超过ttl后重新打开，使被替换的文件能在ttl内生效；已经取出的FileHandle不受淘汰影响。
+ * 只能在所属loop线程中使用
+**/
+class FileCache : noncopyable {
+
+public:
+    FileCache(size_t capacity, Nanoseconds ttl);
+
+    // now通常为EventLoop::now()。打开失败返回nullptr
+    FileHandlePtr open(const std::string& path, Timestamp now);
+
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry {
+        std::string path;
+        FileHandlePtr file;
+        Timestamp opened;
+    };
+    using EntryList = std::list<Entry>;
+
+    const size_t capacity_;
+    const Nanoseconds ttl_;
+    // 表头为最近使用的项
+    EntryList entries_;
+    std::unordered_map<std::string, EntryList::iterator> index_;
+    uint64_t hits_;
+    uint64_t misses_;
+};
+
+} // namespace ev
+
+} // namespace mudong
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cassert>
+
+#include "IdleWheel.hpp"
+#include "TcpConnection.hpp"
+#include "EventLoop.hpp"
+#include "Logger.hpp"
+
+using namespace mudong::ev;
+
+IdleWheel::IdleWheel(EventLoop* loop, IdleKind kind, Nanoseconds timeout, const IdleCallback& callback)
+        : loop_(loop),
+          kind_(kind),
+          timeout_(timeout),
+          tick_(tickFor(timeout)),
+          start_(loop->now()),
+          // 超时时长最多跨越ceil(timeout / tick)个tick，再加上当前槽与取整误差
+          buckets_(static_cast<size_t>((timeout_ + tick_ - Nanoseconds(1)) / tick_) + 2, nullptr),
+          currentTick_(1),
+          size_(0),
+          callback_(callback)
+{
+    assert(timeout_ > Nanoseconds::zero());
+    timer_ = loop_->runEvery(tick_, [this](){onTick();});
+}
+
+IdleWheel::~IdleWheel() {
+    loop_->cancelTimer(timer_);
+    for (auto& head : buckets_) {
+        while (head != nullptr) {
+            unlink(*head);
+        }
+    }
+}
+
+void IdleWheel::add(TcpConnection* conn) {
+    loop_->assertInLoopThread();
+    IdleHook& hook = hookOf(conn);
+    assert(hook.head == nullptr);
+    hook.lastActive = loop_->now();
+    link(hook, hook.lastActive + timeout_);
+    ++size_;
+}
+
+void IdleWheel::remove(TcpConnection* conn) {
+    loop_->assertInLoopThread();
+    IdleHook& hook = hookOf(conn);
+    if (hook.head != nullptr) {
+        unlink(hook);
+        --size_;
+    }
+}
+
+size_t IdleWheel::size() const {
+    return size_;
+}
+
+IdleHook& IdleWheel::hookOf(TcpConnection* conn) const {
+    return kind_ == IdleKind::kRead ? conn->readIdleHook_ : conn->writeIdleHook_;
+}
+
+void IdleWheel::link(IdleHook& hook, Timestamp deadline) {
+    // 到期时刻向上取整到tick，保证检查时已经超时；已经检查过的槽不会再被检查，最早放到当前槽
+    uint64_t tick = currentTick_;
+    if (deadline > start_) {
+        tick = std::max(tick, static_cast<uint64_t>((deadline - start_ + tick_ - Nanoseconds(1)) / tick_));
+    }
+    IdleHook*& head = buckets_[tick % buckets_.size()];
+    hook.head = &head;
+    hook.prev = nullptr;
+    hook.next = head;
+    if (head != nullptr) {
+        head->prev = &hook;
+    }
+    head = &hook;
+}
+
+void IdleWheel::unlink(IdleHook& hook) {
+    assert(hook.head != nullptr);
+    if (hook.prev != nullptr) {
+        hook.prev->next = hook.next;
+    }
+    else {
+        *hook.head = hook.next;
+    }
+    if (hook.next != nullptr) {
+        hook.next->prev = hook.prev;
+    }
+    hook.prev = hook.next = nullptr;
+    hook.head = nullptr;
+}
+
+void IdleWheel::onTick() {
+    Timestamp now = loop_->now();
+    auto nowTick = static_cast<uint64_t>((now - start_) / tick_);
+    // 定时器可能被推迟，补齐期间错过的tick，但一圈之后的槽都已经检查过
+    if (nowTick >= currentTick_ + buckets_.size()) {
+        currentTick_ = nowTick + 1 - buckets_.size();
+    }
+    for (; currentTick_ <= nowTick; ++currentTick_) {
+        IdleHook*& head = buckets_[currentTick_ % buckets_.size()];
+        // 先摘下整条链表，未超时的连接重新挂到更靠后的槽中
+        IdleHook* hook = head;
+        head = nullptr;
+        while (hook != nullptr) {
+            IdleHook* next = hook->next;
+            hook->prev = hook->next = nullptr;
+            hook->head = nullptr;
+            TcpConnection* conn = hook->owner;
+            // 暂停读取期间（如高水位流控）不算读空闲
+            if (kind_ == IdleKind::kRead && !conn->isReading()) {
+                hook->lastActive = now;
+            }
+            if (hook->lastActive + timeout_ <= now) {
+                expired_.push_back(conn->shared_from_this());
+                hook->lastActive = now; // 回调没有关闭连接时，再过一个超时时长会再次回调
+            }
+            link(*hook, hook->lastActive + timeout_);
+            hook = next;
+        }
+    }
+    // 所有节点都已挂回之后再执行回调，回调中移除任何连接都是安全的
+    for (auto& conn : expired_) {
+        callback_(conn, kind_);
+    }
+    expired_.clear();
+}
+
+Nanoseconds IdleWheel::tickFor(Nanoseconds timeout) {
+    return std::max(timeout / kTicksPerTimeout, Nanoseconds(Milliseconds(1)));
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+#include "noncopyable.hpp"
+#include "Callbacks.hpp"
+#include "Timestamp.hpp"
+#include "TimerId.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+class EventLoop;
+class TcpConnection;
+
+// 嵌入在TcpConnection中的侵入式链表节点，每种IdleKind一个
+struct IdleHook {
+    explicit IdleHook(TcpConnection* conn)
+            : owner(conn)
+    {}
+
+    TcpConnection* const owner;
+    IdleHook* prev = nullptr;
+    IdleHook* next = nullptr;
+    // 所在槽的链表头，为nullptr表示不在时间轮中
+    IdleHook** head = nullptr;
+    // 最近一次读到（或写出）数据的时刻，只在loop线程中访问
+    Timestamp lastActive;
+};
+
+/**
+ * 按槽分桶的空闲连接时间轮，每个loop中每种IdleKind一个。一圈覆盖一个超时时长，分为kTicksPerTimeout个tick。
+ * 连接有读写时只更新IdleHook::lastActive而不移动节点；tick转到某个槽时才检查其中的连接，
+ * 真正超时的交给回调，其余的按lastActive重新挂到对应的槽。刷新是O(1)且不分配内存，
+ * 每个连接在一个超时周期内最多被检查一次，而不是每个tick扫描全部连接。
+ * 连接在超时之后的一个tick内被检测到。
+**/
+class IdleWheel: noncopyable {
+
+public:
+    IdleWheel(EventLoop* loop, IdleKind kind, Nanoseconds timeout, const IdleCallback& callback);
+    ~IdleWheel();
+
+    // 只能在loop线程中调用，加入时视为刚刚活跃过
+    void add(TcpConnection* conn);
+    void remove(TcpConnection* conn);
+    size_t size() const;
+
+private:
+    static constexpr int kTicksPerTimeout = 8;
+
+    // 每个tick的时长，最短1ms
+    static Nanoseconds tickFor(Nanoseconds timeout);
+
+    IdleHook& hookOf(TcpConnection* conn) const;
+    void link(IdleHook& hook, Timestamp deadline);
+    void unlink(IdleHook& hook);
+    void onTick();
+
+    EventLoop* loop_;
+    const IdleKind kind_;
+    const Nanoseconds timeout_;
+    const Nanoseconds tick_;
+    const Timestamp start_;
+    std::vector<IdleHook*> buckets_;
+    // 所有小于currentTick_的tick对应的槽都已经检查过
+    uint64_t currentTick_;
+    size_t size_;
+    TimerId timer_;
+    IdleCallback callback_;
+    // 本次tick中超时的连接，复用以避免每次分配
+    std::vector<TcpConnectionPtr> expired_;
+};
+
+} // namespace ev
+
+} // namespace mudong
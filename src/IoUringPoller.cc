@@ -0,0 +1,289 @@
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+
+#include "IoUringPoller.hpp"
+#include "Logger.hpp"
+#include "EventLoop.hpp"
+
+using namespace mudong::ev;
+
+namespace {
+
+const unsigned kRingEntries = 256;
+const unsigned kCompletionEntries = 4096;
+// POLL_REMOVE自身的完成事件使用该user_data，直接丢弃
+const uint64_t kIgnoreUserData = UINT64_MAX;
+
+int ioUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                 const void* arg = nullptr, size_t argSize = 0) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+uint64_t encodeUserData(int fd, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+unsigned* ringField(void* ring, unsigned offset) {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+} // anonymous namespace
+
+IoUringPoller::IoUringPoller(EventLoop* loop)
+        : Poller(loop, Type::kIoUring),
+          sqRing_(MAP_FAILED),
+          sqRingSize_(0),
+          cqRing_(MAP_FAILED),
+          cqRingSize_(0),
+          sqes_(nullptr),
+          sqesSize_(0),
+          registrations_(64)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCompletionEntries;
+    ringfd_ = ioUringSetup(kRingEntries, &params);
+    if (ringfd_ == -1) {
+        SYSFATAL("IoUringPoller::io_uring_setup");
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // 新内核中SQ和CQ两个ring可以通过一次mmap映射
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        SYSFATAL("IoUringPoller::mmap sq ring");
+    }
+    if (singleMmap) {
+        cqRing_ = sqRing_;
+    }
+    else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            SYSFATAL("IoUringPoller::mmap cq ring");
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        SYSFATAL("IoUringPoller::mmap sqes");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_ = ringField(sqRing_, params.sq_off.head);
+    sqTail_ = ringField(sqRing_, params.sq_off.tail);
+    sqMask_ = *ringField(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = *ringField(sqRing_, params.sq_off.ring_entries);
+    sqArray_ = ringField(sqRing_, params.sq_off.array);
+    cqHead_ = ringField(cqRing_, params.cq_off.head);
+    cqTail_ = ringField(cqRing_, params.cq_off.tail);
+    cqMask_ = *ringField(cqRing_, params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cqRing_) + params.cq_off.cqes);
+}
+
+IoUringPoller::~IoUringPoller() {
+    munmap(sqes_, sqesSize_);
+    if (cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    munmap(sqRing_, sqRingSize_);
+    close(ringfd_);
+}
+
+const char* IoUringPoller::unavailableReason() {
+    static const char* const reason = []() -> const char* {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = ioUringSetup(1, &params);
+        if (fd == -1) {
+            return "io_uring_setup failed";
+        }
+        close(fd);
+        if ((params.features & IORING_FEAT_EXT_ARG) == 0) {
+            // 5.11之前的内核没有带超时的等待
+            return "kernel lacks IORING_FEAT_EXT_ARG";
+        }
+        return nullptr;
+    }();
+    return reason;
+}
+
+void IoUringPoller::poll(ChannelList& activeChannels, Nanoseconds timeout) {
+    loop_->assertInLoopThread();
+    // 上一轮触发过的Channel在这里统一重新提交POLL_ADD，与等待一起批量进入内核
+    for (int fd : rearmList_) {
+        Registration& reg = registrations_[static_cast<size_t>(fd)];
+        reg.rearming = false;
+        if (reg.channel != nullptr && !reg.armed && !reg.channel->isNoneEvents()) {
+            arm(fd, reg);
+        }
+    }
+    rearmList_.clear();
+
+    // 内核每消费一个SQE就推进head，两者之差即为尚未提交的请求数
+    unsigned toSubmit = *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    int ret;
+    if (timeout < Nanoseconds::zero()) {
+        ret = ioUringEnter(ringfd_, toSubmit, 1, IORING_ENTER_GETEVENTS);
+    }
+    else if (timeout == Nanoseconds::zero()) {
+        // 不等待，但仍需GETEVENTS让内核处理挂起的task_work，把已就绪的poll请求放入CQ
+        ret = ioUringEnter(ringfd_, toSubmit, 0, IORING_ENTER_GETEVENTS);
+    }
+    else {
+        __kernel_timespec ts;
+        ts.tv_sec = timeout.count() / std::nano::den;
+        ts.tv_nsec = timeout.count() % std::nano::den;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        ret = ioUringEnter(ringfd_, toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    if (ret == -1) {
+        if (errno != EINTR && errno != ETIME) { // signal: interrupted sys call; ETIME: 超时
+            SYSERR("IoUringPoller::io_uring_enter");
+        }
+    }
+    reapCompletions(activeChannels);
+}
+
+void IoUringPoller::updateChannel(Channel* channel) {
+    loop_->assertInLoopThread();
+    int fd = channel->fd();
+    if (static_cast<size_t>(fd) >= registrations_.size()) {
+        registrations_.resize(std::max(registrations_.size() * 2, static_cast<size_t>(fd) + 1));
+    }
+    Registration& reg = registrations_[static_cast<size_t>(fd)];
+    if (!channel->pooling) { // 添加
+        assert(!channel->isNoneEvents());
+        channel->pooling = true;
+        if (reg.armed) { // fd被复用，而旧的Channel没有从Poller中移除
+            disarm(fd, reg);
+        }
+        reg.channel = channel;
+        arm(fd, reg);
+    }
+    else if (!channel->isNoneEvents()) { // 修改：撤销旧的poll请求，在下一次poll时按新的事件重新提交
+        assert(reg.channel == channel);
+        if (reg.armed) {
+            disarm(fd, reg);
+        }
+        scheduleRearm(fd, reg);
+    }
+    else { // 删除
+        channel->pooling = false;
+        if (reg.armed) {
+            disarm(fd, reg);
+        }
+        reg.channel = nullptr;
+    }
+}
+
+io_uring_sqe* IoUringPoller::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail_;
+    // 提交队列已满，先把已有的请求交给内核，直到内核消费了至少一个槽位；内核可能只消费一部分
+    while (tail - head >= sqEntries_) {
+        int ret = ioUringEnter(ringfd_, tail - head, 0, 0);
+        if (ret == -1) {
+            if (errno == EBUSY) {
+                // 完成队列溢出，内核要等完成事件被取走才接受新的提交
+                discardCompletions();
+            }
+            else if (errno != EINTR && errno != EAGAIN) {
+                SYSFATAL("IoUringPoller::io_uring_enter submit");
+            }
+        }
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    }
+    unsigned index = tail & sqMask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+void IoUringPoller::arm(int fd, Registration& reg) {
+    assert(!reg.armed);
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    // io_uring的poll只有水平触发语义，EPOLLET等epoll专有标志需要去掉
+    sqe->poll32_events = reg.channel->events() & ~static_cast<unsigned>(EPOLLET | EPOLLONESHOT);
+    sqe->user_data = encodeUserData(fd, ++reg.generation);
+    reg.armed = true;
+}
+
+void IoUringPoller::disarm(int fd, Registration& reg) {
+    assert(reg.armed);
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = encodeUserData(fd, reg.generation);
+    sqe->user_data = kIgnoreUserData;
+    // 即使旧请求在撤销前已经完成，generation不匹配也会使其被忽略
+    ++reg.generation;
+    reg.armed = false;
+}
+
+void IoUringPoller::scheduleRearm(int fd, Registration& reg) {
+    if (!reg.rearming) {
+        reg.rearming = true;
+        rearmList_.push_back(fd);
+    }
+}
+
+IoUringPoller::Registration* IoUringPoller::completed(const io_uring_cqe& cqe) {
+    if (cqe.user_data == kIgnoreUserData) {
+        return nullptr;
+    }
+    auto fd = static_cast<size_t>(cqe.user_data & 0xffffffff);
+    auto generation = static_cast<uint32_t>(cqe.user_data >> 32);
+    if (fd >= registrations_.size()) {
+        return nullptr;
+    }
+    Registration& reg = registrations_[fd];
+    if (reg.channel == nullptr || !reg.armed || reg.generation != generation) {
+        return nullptr; // 过期的完成事件
+    }
+    reg.armed = false;
+    scheduleRearm(static_cast<int>(fd), reg);
+    return &reg;
+}
+
+void IoUringPoller::reapCompletions(ChannelList& activeChannels) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes_[head & cqMask_];
+        Registration* reg = completed(cqe);
+        if (reg == nullptr) {
+            continue;
+        }
+        unsigned revents = cqe.res >= 0 ? static_cast<unsigned>(cqe.res) : static_cast<unsigned>(EPOLLERR);
+        reg->channel->setRevents(revents);
+        activeChannels.push_back(reg->channel);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::discardCompletions() {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        completed(cqes_[head & cqMask_]);
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+}
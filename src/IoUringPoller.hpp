@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <linux/io_uring.h>
+
+#include "Poller.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+/**
+ * 基于io_uring的Poller，直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing。
+ * 每个Channel对应一个one-shot的IORING_OP_POLL_ADD请求，完成后在下一次poll时重新提交，
+ * 语义上等价于epoll的水平触发。所有的提交与等待完成都合并在同一次io_uring_enter中。
+**/
+class IoUringPoller: public Poller {
+
+public:
+    explicit IoUringPoller(EventLoop* loop);
+    ~IoUringPoller() override;
+
+    void poll(ChannelList& activeChannels, Nanoseconds timeout) override;
+    void updateChannel(Channel* channel) override;
+
+    // 当前内核不支持io_uring（可能被seccomp等禁用）的原因，可用时为nullptr。带超时的等待需要IORING_FEAT_EXT_ARG
+    static const char* unavailableReason();
+
+private:
+    // 以fd为下标，generation用于识别已被取消或替换的poll请求产生的过期完成事件
+    struct Registration {
+        Channel* channel = nullptr;
+        uint32_t generation = 0;
+        bool armed = false;
+        bool rearming = false;
+    };
+
+    io_uring_sqe* getSqe();
+    void arm(int fd, Registration& reg);
+    void disarm(int fd, Registration& reg);
+    void scheduleRearm(int fd, Registration& reg);
+    // 完成事件对应的poll请求仍然有效时返回其Registration，并安排在下一次poll时重新提交
+    Registration* completed(const io_uring_cqe& cqe);
+    void reapCompletions(ChannelList& activeChannels);
+    /**
+     * 提交时遇到完成队列溢出，在poll之外取走并丢弃完成事件。poll请求只有水平触发语义，
+     * 被丢弃的fd会在下一次poll时重新提交，仍然就绪的话立即再次报告，不会丢失事件
+    **/
+    void discardCompletions();
+
+    int ringfd_;
+
+    void* sqRing_;
+    size_t sqRingSize_;
+    void* cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned* sqArray_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe* cqes_;
+
+    std::vector<Registration> registrations_;
+    std::vector<int> rearmList_;
+};
+
+} // namespace ev
+
+} // namespace mudong
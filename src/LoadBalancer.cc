@@ -0,0 +1,40 @@
+#include "LoadBalancer.hpp"
+
+#include <algorithm>
+
+namespace mudong {
+
+namespace ev {
+
+LoadBalancer roundRobinBalancer() {
+    return [next = size_t(0)](const std::vector<LoopLoad>& loads) mutable {
+        return next++ % loads.size();
+    };
+}
+
+LoadBalancer leastConnectionsBalancer() {
+    return [](const std::vector<LoopLoad>& loads) {
+        auto it = std::min_element(loads.begin(), loads.end(),
+                [](const LoopLoad& lhs, const LoopLoad& rhs) {
+                    return lhs.connections < rhs.connections;
+                });
+        return static_cast<size_t>(it - loads.begin());
+    };
+}
+
+LoadBalancer leastQueuedBytesBalancer() {
+    return [](const std::vector<LoopLoad>& loads) {
+        auto it = std::min_element(loads.begin(), loads.end(),
+                [](const LoopLoad& lhs, const LoopLoad& rhs) {
+                    if (lhs.queuedBytes != rhs.queuedBytes) {
+                        return lhs.queuedBytes < rhs.queuedBytes;
+                    }
+                    return lhs.connections < rhs.connections;
+                });
+        return static_cast<size_t>(it - loads.begin());
+    };
+}
+
+} // namespace ev
+
+} // namespace mudong
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace mudong {
+
+namespace ev {
+
+// 主从Reactor模式下一个子loop的负载快照，分派每个连接前生成
+struct LoopLoad {
+    // 已经分派给该loop、还没有关闭的连接数，包括尚未在该loop中建立的连接
+    size_t connections;
+    // 该loop上所有连接还没有写出的字节数，包括outputBuffer与排队的文件、零拷贝段
+    size_t queuedBytes;
+};
+
+/**
+ * 返回loads中被选中的loop的下标，只在baseLoop线程中调用，可以保存自己的状态。
+ * loads至少有一项，越界的返回值按loads.size()取模
+**/
+using LoadBalancer = std::function<size_t(const std::vector<LoopLoad>& loads)>;
+
+// 依次轮流
+LoadBalancer roundRobinBalancer();
+// 连接数最少的loop，相同时取下标小的
+LoadBalancer leastConnectionsBalancer();
+// 待发送字节数最少的loop，相同时取连接数少的
+LoadBalancer leastQueuedBytesBalancer();
+
+} // namespace ev
+
+} // namespace mudong
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "noncopyable.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+/**
+ * 无锁的多生产者单消费者队列。生产者通过CAS将节点压入链表头部，从不阻塞；
+ * 消费者一次exchange取走整条链表，原地反转为FIFO顺序后依次处理，取出过程不分配内存。
+ * 与原先交换std::vector的做法一样，每次drain只处理调用时刻已经入队的元素，
+ * 处理过程中新入队的元素留给下一次drain。
+ * 处理完的节点不释放，由消费者整批归还到freeList_；生产者从线程局部的缓存中取节点，
+ * 缓存用完时一次exchange取走freeList_中的全部节点。两边都只有压入与整体取走，没有ABA问题，
+ * 稳态下入队不再经过全局的内存分配器。构造时可以预先分配reserve个节点放入freeList_，
+ * 未取出的元素不超过这个数量时，入队从第一次起就不分配内存。
+**/
+template <typename T>
+class MpscQueue: noncopyable {
+
+public:
+    explicit MpscQueue(size_t reserve = 0)
+            : head_(nullptr),
+              freeList_(nullptr)
+    {
+        Node* chain = nullptr;
+        for (size_t i = 0; i < reserve; ++i) {
+            Node* node = new Node;
+            node->next = chain;
+            chain = node;
+        }
+        freeList_.store(chain, std::memory_order_release);
+    }
+
+    ~MpscQueue() {
+        Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+        while (node != nullptr) {
+            Node* next = node->next;
+            node->value()->~T();
+            delete node;
+            node = next;
+        }
+        deleteChain(freeList_.exchange(nullptr, std::memory_order_acquire));
+    }
+
+    // 可以在任意线程中调用
+    void push(T&& value) {
+        Node* node = allocateNode();
+        new (node->storage) T(std::move(value));
+        pushNode(node);
+    }
+
+    void push(const T& value) {
+        Node* node = allocateNode();
+        new (node->storage) T(value);
+        pushNode(node);
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == nullptr;
+    }
+
+    // 只能在消费者线程中调用，按入队顺序对每个元素调用func，返回处理的元素个数
+    template <typename Func>
+    size_t drain(Func&& func) {
+        Node* node = head_.exchange(nullptr, std::memory_order_acquire);
+        Node* reversed = nullptr;
+        while (node != nullptr) {
+            Node* next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+        size_t count = 0;
+        Node* recycled = nullptr;
+        Node* recycledTail = nullptr;
+        while (reversed != nullptr) {
+            Node* next = reversed->next;
+            func(*reversed->value());
+            reversed->value()->~T();
+            reversed->next = recycled;
+            recycled = reversed;
+            if (recycledTail == nullptr) {
+                recycledTail = reversed;
+            }
+            reversed = next;
+            ++count;
+        }
+        if (recycled != nullptr) {
+            recycledTail->next = freeList_.load(std::memory_order_relaxed);
+            while (!freeList_.compare_exchange_weak(recycledTail->next, recycled,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed))
+            {}
+        }
+        return count;
+    }
+
+private:
+    struct Node {
+        Node* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* value() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+    };
+
+    // 每个线程缓存的空闲节点，同类型的所有队列共用，线程退出时释放
+    struct NodeCache {
+        Node* head = nullptr;
+
+        ~NodeCache() {
+            deleteChain(head);
+        }
+    };
+
+    static void deleteChain(Node* node) {
+        while (node != nullptr) {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    Node* allocateNode() {
+        static thread_local NodeCache cache;
+        if (cache.head == nullptr) {
+            cache.head = freeList_.exchange(nullptr, std::memory_order_acquire);
+            if (cache.head == nullptr) {
+                return new Node;
+            }
+        }
+        Node* node = cache.head;
+        cache.head = node->next;
+        return node;
+    }
+
+    void pushNode(Node* node) {
+        node->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(node->next, node,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed))
+        {}
+    }
+
+    std::atomic<Node*> head_;
+    // 消费者归还的空闲节点
+    std::atomic<Node*> freeList_;
+};
+
+} // namespace ev
+
+} // namespace mudong
@@ -0,0 +1,61 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "Poller.hpp"
+#include "EPollPoller.hpp"
+#include "IoUringPoller.hpp"
+#include "Logger.hpp"
+
+using namespace mudong::ev;
+
+Poller::Poller(EventLoop* loop, Type type)
+        : loop_(loop),
+          preciseTimeout_(false),
+          type_(type)
+{}
+
+Poller::~Poller() = default;
+
+std::unique_ptr<Poller> Poller::newPoller(EventLoop* loop, Type type) {
+    if (type == Type::kIoUring) {
+        const char* reason = IoUringPoller::unavailableReason();
+        if (reason == nullptr) {
+            return std::make_unique<IoUringPoller>(loop);
+        }
+        WARN("Poller::newPoller io_uring unavailable ({}), fall back to epoll", reason);
+    }
+    return std::make_unique<EPollPoller>(loop);
+}
+
+Poller::Type Poller::type() const {
+    return type_;
+}
+
+bool Poller::supportsEdgeTriggered() const {
+    return false;
+}
+
+void Poller::setPreciseTimeout(bool precise) {
+    preciseTimeout_ = precise;
+}
+
+bool Poller::preciseTimeout() const {
+    return preciseTimeout_;
+}
+
+Poller::Type Poller::defaultType() {
+    const char* env = ::getenv("MUDONG_EV_POLLER");
+    if (env != nullptr && strcmp(env, "io_uring") == 0) {
+        return Type::kIoUring;
+    }
+    return Type::kEPoll;
+}
+
+const char* Poller::typeName(Type type) {
+    switch (type) {
+        case Type::kIoUring:
+            return "io_uring";
+        default:
+            return "epoll";
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "noncopyable.hpp"
+#include "Timestamp.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+class EventLoop;
+class Channel;
+
+// IO多路复用的抽象接口，EventLoop在构造时选定具体的后端
+class Poller: noncopyable {
+
+public:
+    using ChannelList = std::vector<Channel*>;
+
+    static constexpr Nanoseconds kPollForever{-1};
+
+    enum class Type {
+        kEPoll,
+        kIoUring
+    };
+
+    Poller(EventLoop* loop, Type type);
+    virtual ~Poller();
+
+    // 等待事件，将触发的Channel装载入activeChannels中。timeout为负数时一直阻塞，为0时立即返回
+    virtual void poll(ChannelList& activeChannels, Nanoseconds timeout) = 0;
+    // 根据Channel当前关注的事件，完成添加、修改或删除
+    virtual void updateChannel(Channel* channel) = 0;
+
+    Type type() const;
+    // 是否支持EPOLLET边沿触发
+    virtual bool supportsEdgeTriggered() const;
+    // 为true时poll的超时精确到亚毫秒级，否则允许后端按毫秒向上取整
+    void setPreciseTimeout(bool precise);
+    bool preciseTimeout() const;
+
+    // 创建指定类型的Poller，若io_uring不可用则退回epoll
+    static std::unique_ptr<Poller> newPoller(EventLoop* loop, Type type);
+    // 默认使用epoll，设置环境变量MUDONG_EV_POLLER=io_uring时使用io_uring
+    static Type defaultType();
+    static const char* typeName(Type type);
+
+protected:
+    EventLoop* loop_;
+    bool preciseTimeout_;
+
+private:
+    const Type type_;
+};
+
+} // namespace ev
+
+} // namespace mudong
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mudong {
+
+namespace ev {
+
+/**
+ * 只能移动的void()可调用对象，用于EventLoop与ThreadPool中排队的任务。
+ * 与std::function相比去掉了拷贝语义，并把内联存储扩大到kInlineSize字节：
+ * 捕获一个shared_ptr加一个std::string（TcpConnection::send），或者std::bind一个std::function加shared_ptr，
+ * 都可以直接放在对象内部而不用堆分配。超过容量或移动构造可能抛异常的可调用对象仍然放在堆上。
+**/
+class Task {
+
+public:
+    static constexpr size_t kInlineSize = 48;
+
+    Task() noexcept
+            : ops_(nullptr)
+    {}
+
+    Task(std::nullptr_t) noexcept
+            : ops_(nullptr)
+    {}
+
+    template <typename F,
+              typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task> &&
+                                          std::is_invocable_r_v<void, std::decay_t<F>&>>>
+    Task(F&& func) {
+        using Func = std::decay_t<F>;
+        if constexpr (kFitsInline<Func>) {
+            new (&storage_) Func(std::forward<F>(func));
+            ops_ = &kInlineOps<Func>;
+        }
+        else {
+            new (&storage_) Func*(new Func(std::forward<F>(func)));
+            ops_ = &kHeapOps<Func>;
+        }
+    }
+
+    Task(Task&& rhs) noexcept
+            : ops_(rhs.ops_)
+    {
+        if (ops_ != nullptr) {
+            ops_->move(&rhs.storage_, &storage_);
+            rhs.ops_ = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& rhs) noexcept {
+        if (this != &rhs) {
+            reset();
+            if (rhs.ops_ != nullptr) {
+                rhs.ops_->move(&rhs.storage_, &storage_);
+                ops_ = rhs.ops_;
+                rhs.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset();
+    }
+
+    void operator()() {
+        assert(ops_ != nullptr);
+        ops_->invoke(&storage_);
+    }
+
+    explicit operator bool() const noexcept {
+        return ops_ != nullptr;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        // 将src中的对象移动到dst中，并析构src中的对象
+        void (*move)(void* src, void* dst) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename Func>
+    static constexpr bool kFitsInline = sizeof(Func) <= kInlineSize &&
+                                        alignof(Func) <= alignof(std::max_align_t) &&
+                                        std::is_nothrow_move_constructible_v<Func>;
+
+    template <typename Func>
+    static constexpr Ops kInlineOps = {
+        [](void* storage) { (*static_cast<Func*>(storage))(); },
+        [](void* src, void* dst) noexcept {
+            new (dst) Func(std::move(*static_cast<Func*>(src)));
+            static_cast<Func*>(src)->~Func();
+        },
+        [](void* storage) noexcept { static_cast<Func*>(storage)->~Func(); }
+    };
+
+    // 堆上的对象只需转移指针
+    template <typename Func>
+    static constexpr Ops kHeapOps = {
+        [](void* storage) { (**static_cast<Func**>(storage))(); },
+        [](void* src, void* dst) noexcept { new (dst) Func*(*static_cast<Func**>(src)); },
+        [](void* storage) noexcept { delete *static_cast<Func**>(storage); }
+    };
+
+    void reset() noexcept {
+        if (ops_ != nullptr) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    const Ops* ops_;
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+};
+
+static_assert(sizeof(Task) == 64, "Task should fit in one cache line");
+
+} // namespace ev
+
+} // namespace mudong
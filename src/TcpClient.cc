@@ -10,7 +10,6 @@ TcpClient::TcpClient(EventLoop* loop, const InetAddress& peer)
         : loop_(loop),
           connected_(false),
           peer_(peer),
-          retryTimer_(nullptr),
           connector_(new Connector(loop, peer)),
           connectionCallback_(defaultConnectionCallback),
           messageCallback_(defaultMessageCallback)
@@ -26,11 +25,13 @@ TcpClient::TcpClient(EventLoop* loop, const InetAddress& peer)
 
 TcpClient::~TcpClient() {
     if (connection_ && !connection_->disconnected()) {
-        connection_->forceClose();
-    }
-    if (retryTimer_ != nullptr) {
-        loop_->cancelTimer(retryTimer_);
+        // 在loop线程中直接断开，排队的forceClose可能在loop析构前都不会执行
+        if (loop_->isInLoopThread()) {
+            connection_->connectDestroyed();
+        }
+        else connection_->forceClose();
     }
+    loop_->cancelTimer(retryTimer_);
 }
 
 void TcpClient::setConnectionCallback(const ConnectionCallback& callback) {
@@ -71,13 +72,15 @@ void TcpClient::retry() {
 void TcpClient::newConnection(int connfd, const InetAddress& local, const InetAddress& peer) {
     loop_->assertInLoopThread();
     loop_->cancelTimer(retryTimer_);
-    retryTimer_ = nullptr;
+    retryTimer_ = TimerId();
     connected_ = true;
     auto conn = std::make_shared<TcpConnection>(loop_, connfd, local, peer);
     connection_ = conn;
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-    conn->setCloseCallback(std::bind(&TcpClient::closeConnection, this, std::placeholders::_1));
+    auto callbacks = std::make_shared<TcpConnectionCallbacks>();
+    callbacks->message = messageCallback_;
+    callbacks->writeComplete = writeCompleteCallback_;
+    callbacks->close = std::bind(&TcpClient::closeConnection, this, std::placeholders::_1);
+    conn->setCallbacks(callbacks);
 
     conn->connectEstablished();
     connectionCallback_(conn);
@@ -2,7 +2,7 @@
 
 #include "Callbacks.hpp"
 #include "Connector.hpp"
-#include "Timer.hpp"
+#include "TimerId.hpp"
 
 namespace mudong {
 
@@ -31,7 +31,7 @@ private:
     EventLoop* loop_;
     bool connected_;
     const InetAddress peer_;
-    Timer* retryTimer_;
+    TimerId retryTimer_;
     ConnectorPtr connector_;
     TcpConnectionPtr connection_;
     ConnectionCallback connectionCallback_;
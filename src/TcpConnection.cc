@@ -2,8 +2,21 @@
 #include "Logger.hpp"
 #include "EventLoop.hpp"
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <vector>
+
 using namespace mudong::ev;
 
+const size_t TcpConnection::kZeroCopyThreshold;
+const int TcpConnection::kReadBudget;
+
 namespace {
 
 enum ConnectState {
@@ -13,6 +26,12 @@ enum ConnectState {
     kDisconnected
 };
 
+// 新建连接在设置回调表之前共用的空表
+const TcpConnectionCallbacksPtr& emptyCallbacks() {
+    static const TcpConnectionCallbacksPtr callbacks = std::make_shared<const TcpConnectionCallbacks>();
+    return callbacks;
+}
+
 } // anonymous namespace
 
 namespace mudong {
@@ -29,24 +48,47 @@ void defaultMessageCallback(const TcpConnectionPtr& conn, Buffer& buffer) {
     TRACE("Connection {} -> {} recv {} bytes", conn->peer().toIpPort(), conn->local().toIpPort(), buffer.readableBytes());
     buffer.retrieveAll();
 }
+void defaultIdleCallback(const TcpConnectionPtr& conn, IdleKind kind) {
+    INFO("Connection {} {} idle timeout, force close", conn->name(), kind == IdleKind::kRead ? "read" : "write");
+    conn->forceClose();
+}
 
 } // namespace ev
 
 } // namespace mudong
 
+// 处理事件前从enable_shared_from_this中取得引用，连接在处理过程中不会析构
+const Channel::Handlers TcpConnection::kChannelHandlers = {
+    [](void* owner) { static_cast<TcpConnection*>(owner)->handleRead(); },
+    [](void* owner) { static_cast<TcpConnection*>(owner)->handleWrite(); },
+    [](void* owner) { static_cast<TcpConnection*>(owner)->handleClose(); },
+    [](void* owner) { static_cast<TcpConnection*>(owner)->handleError(); },
+    [](void* owner) -> std::shared_ptr<void> { return static_cast<TcpConnection*>(owner)->weak_from_this().lock(); }
+};
+
 TcpConnection::TcpConnection(EventLoop* loop, int sockfd, const InetAddress& local, const InetAddress& peer)
         : loop_(loop),
           sockfd_(sockfd),
-          channel_(loop, sockfd_),
           state_(kConnecting),
+          edgeTriggered_(false),
+          corked_(false),
+          flushQueued_(false),
+          readPaused_(0),
+          channel_(loop, sockfd_),
           local_(local),
           peer_(peer),
-          highWaterMark_(0)
+          bufferPool_(loop->bufferPool()),
+          segmentBytes_(0),
+          reportedOutput_(0),
+          context_(nullptr),
+          contextType_(nullptr),
+          readIdleHook_(this),
+          writeIdleHook_(this),
+          callbacks_(emptyCallbacks())
 {
-    channel_.setReadCallback([this](){handleRead();});
-    channel_.setWriteCallback([this](){handleWrite();});
-    channel_.setCloseCallback([this](){handleClose();});
-    channel_.setErrorCallback([this](){handleError();});
+    channel_.setHandlers(&kChannelHandlers, this);
+    inputBuffer_.setPool(bufferPool_);
+    outputBuffer_.setPool(bufferPool_);
 
     TRACE("TcpConnection() {} fd={}", name(), sockfd_);
 }
@@ -58,26 +100,76 @@ TcpConnection::~TcpConnection() {
     TRACE("~TcpConnection() {} fd={}", name(), sockfd_);
 }
 
+void TcpConnection::setCallbacks(const TcpConnectionCallbacksPtr& callbacks) {
+    assert(callbacks != nullptr);
+    callbacks_ = callbacks;
+}
 void TcpConnection::setMessageCallback(const MessageCallback& callback) {
-    messageCallback_ = callback;
+    mutableCallbacks().message = callback;
 }
 void TcpConnection::setWriteCompleteCallback(const WriteCompleteCallback& callback) {
-    writeCompleteCallback_ = callback;
+    mutableCallbacks().writeComplete = callback;
 }
 void TcpConnection::setHighWaterMarkCallback(const HighWaterMarkCallback& callback, size_t mark) {
-    highWaterMark_ = mark;
-    highWaterMarkCallback_ = callback;
+    TcpConnectionCallbacks& callbacks = mutableCallbacks();
+    callbacks.highWaterMarkBytes = mark;
+    callbacks.highWaterMark = callback;
 }
 void TcpConnection::setCloseCallback(const CloseCallback& callback) {
-    closeCallback_ = callback;
+    mutableCallbacks().close = callback;
+}
+void TcpConnection::setFlowControl(const FlowControl& flowControl) {
+    assert(flowControl.outputLowWater <= flowControl.outputHighWater);
+    mutableCallbacks().flowControl = flowControl;
+}
+
+TcpConnectionCallbacks& TcpConnection::mutableCallbacks() {
+    auto copy = std::make_shared<TcpConnectionCallbacks>(*callbacks_);
+    callbacks_ = copy;
+    return *copy;
+}
+
+void TcpConnection::setEdgeTriggered(bool on) {
+    assert(state_ == kConnecting);
+    if (on && !loop_->supportsEdgeTriggered()) {
+        WARN("TcpConnection::setEdgeTriggered() poller {} is level-triggered only", Poller::typeName(loop_->pollerType()));
+        on = false;
+    }
+    edgeTriggered_ = on;
+}
+bool TcpConnection::edgeTriggered() const {
+    return edgeTriggered_;
+}
+
+void TcpConnection::setCorked(bool on) {
+    loop_->assertInLoopThread();
+    corked_ = on;
+    if (!on) {
+        flushOutput(); // 积累的数据立即写出，已经登记的合并写随之变为空操作
+    }
+}
+bool TcpConnection::corked() const {
+    return corked_;
 }
 
 void TcpConnection::connectEstablished() {
     assert(state_ == kConnecting);
     state_ = kConnected;
-    channel_.tie(shared_from_this()); // 将socketfd_的Channel和TcpConnection绑定
+    if (edgeTriggered_) {
+        channel_.setEdgeTriggered(true);
+        channel_.enableWrite(); // 边沿触发下EPOLLOUT常驻，只在可写边沿通知一次
+    }
     channel_.enableRead(); // 打开socket的读
 }
+void TcpConnection::connectDestroyed() {
+    loop_->assertInLoopThread();
+    if (state_ != kDisconnected) {
+        state_ = kDisconnected;
+        loop_->removeChannel(&channel_);
+        reportOutput();
+        lingerZeroCopy();
+    }
+}
 bool TcpConnection::connected() const {
     return state_ == kConnected;
 }
@@ -95,19 +187,12 @@ std::string TcpConnection::name() const {
     return peer_.toIpPort() + " -> " + local_.toIpPort();
 }
 
-void TcpConnection::setContext(const std::any& context) {
-    context_ = context;
-}
-const std::any& TcpConnection::getContext() const {
-    return context_;
-}
-std::any& TcpConnection::getContext() {
-    return context_;
-}
-
 void TcpConnection::send(std::string_view data) {
     send(data.data(), data.length());
 }
+void TcpConnection::send(const char* data) {
+    send(std::string_view(data));
+}
 void TcpConnection::send(const char* data, size_t len) {
     if (state_ != kConnected) {
         WARN("TcpConnection::send() not connected, give up send");
@@ -137,6 +222,163 @@ void TcpConnection::send(Buffer& buffer) {
         loop_->queueInLoop([ptr = shared_from_this(), str = buffer.retrieveAllAsString()](){ptr->sendInLoop(str);});
     }
 }
+void TcpConnection::send(std::string&& data) {
+    if (state_ != kConnected) {
+        WARN("TcpConnection::send() not connected, give up send");
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendInLoop(data);
+    }
+    else {
+        loop_->queueInLoop([ptr = shared_from_this(), str = std::move(data)]() { ptr->sendInLoop(str); });
+    }
+}
+void TcpConnection::send(Buffer&& buffer) {
+    if (state_ != kConnected) {
+        WARN("TcpConnection::send() not connected, give up send");
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendInLoop(buffer.peek(), buffer.readableBytes());
+        buffer.retrieveAll();
+    }
+    else {
+        // 存储随moved转移到loop中，在那里析构；池的块可以在任意线程中归还
+        Buffer moved(std::move(buffer));
+        buffer.setPool(moved.pool());
+        loop_->queueInLoop([ptr = shared_from_this(), moved = std::move(moved)]() {
+            ptr->sendInLoop(moved.peek(), moved.readableBytes());
+        });
+    }
+}
+void TcpConnection::send(const std::shared_ptr<const std::string>& data) {
+    sendZeroCopy(data);
+}
+void TcpConnection::send(std::span<const std::string_view> pieces) {
+    // 段数不多时iovec数组放在栈上
+    const size_t kStackPieces = 16;
+    struct iovec stackVec[kStackPieces] = {};
+    std::vector<struct iovec> heapVec;
+    struct iovec* vec = stackVec;
+    if (pieces.size() > kStackPieces) {
+        heapVec.resize(pieces.size());
+        vec = heapVec.data();
+    }
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        vec[i].iov_base = const_cast<char*>(pieces[i].data());
+        vec[i].iov_len = pieces[i].size();
+    }
+    send(vec, static_cast<int>(pieces.size()));
+}
+void TcpConnection::send(const struct iovec* iov, int iovcnt) {
+    if (state_ != kConnected) {
+        WARN("TcpConnection::send() not connected, give up send");
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendInLoop(iov, iovcnt);
+    }
+    else {
+        std::string str;
+        for (int i = 0; i < iovcnt; ++i) {
+            str.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        loop_->queueInLoop([ptr = shared_from_this(), str = std::move(str)]() { ptr->sendInLoop(str); });
+    }
+}
+
+bool TcpConnection::sendFile(int fd, off_t offset, size_t length) {
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        SYSERR("TcpConnection::sendFile() fstat");
+        return false;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode)) {
+        ERROR("TcpConnection::sendFile() fd {} is not a regular file", fd);
+        return false;
+    }
+    int dupfd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dupfd == -1) {
+        SYSERR("TcpConnection::sendFile() dup");
+        return false;
+    }
+    sendFile(std::make_shared<FileHandle>(dupfd, static_cast<size_t>(offset) + length), offset, length);
+    return true;
+}
+void TcpConnection::sendFile(const FileHandlePtr& file, off_t offset, size_t length) {
+    if (state_ != kConnected) {
+        WARN("TcpConnection::sendFile() not connected, give up send");
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendFileInLoop(file, offset, length);
+    }
+    else {
+        loop_->queueInLoop([ptr = shared_from_this(), file, offset, length]() {
+            ptr->sendFileInLoop(file, offset, length);
+        });
+    }
+}
+bool TcpConnection::sendFile(const std::string& path, off_t offset, size_t length) {
+    loop_->assertInLoopThread();
+    FileCache* cache = loop_->fileCache();
+    FileHandlePtr file = cache != nullptr ? cache->open(path, loop_->now()) : FileHandle::open(path);
+    if (file == nullptr) {
+        SYSERR("TcpConnection::sendFile() open {}", path);
+        return false;
+    }
+    if (length == 0) {
+        size_t begin = static_cast<size_t>(offset);
+        length = file->size() > begin ? file->size() - begin : 0;
+    }
+    sendFile(file, offset, length);
+    return true;
+}
+
+bool TcpConnection::enableZeroCopy(size_t threshold) {
+    loop_->assertInLoopThread();
+    if (zeroCopy_ == nullptr) {
+        int on = 1;
+        if (::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == -1) {
+            SYSERR("TcpConnection::setsockopt(SO_ZEROCOPY)");
+            return false;
+        }
+        zeroCopy_ = std::make_unique<ZeroCopyState>();
+        zeroCopy_->nextId = 0;
+        zeroCopy_->copied = 0;
+    }
+    zeroCopy_->threshold = threshold;
+    return true;
+}
+bool TcpConnection::zeroCopyEnabled() const {
+    return zeroCopy_ != nullptr;
+}
+size_t TcpConnection::zeroCopyInflight() const {
+    return zeroCopy_ == nullptr ? 0 : zeroCopy_->inflight.size();
+}
+uint64_t TcpConnection::zeroCopyCopied() const {
+    return zeroCopy_ == nullptr ? 0 : zeroCopy_->copied;
+}
+
+void TcpConnection::sendZeroCopy(const char* data, size_t len, std::shared_ptr<const void> holder) {
+    if (state_ != kConnected) {
+        WARN("TcpConnection::sendZeroCopy() not connected, give up send");
+        return;
+    }
+    if (loop_->isInLoopThread()) {
+        sendZeroCopyInLoop(data, len, holder);
+    }
+    else {
+        // 只传递引用，数据本身不拷贝
+        loop_->queueInLoop([ptr = shared_from_this(), data, len, holder = std::move(holder)]() {
+            ptr->sendZeroCopyInLoop(data, len, holder);
+        });
+    }
+}
+void TcpConnection::sendZeroCopy(const std::shared_ptr<const std::string>& data) {
+    sendZeroCopy(data->data(), data->size(), data);
+}
 
 void TcpConnection::shutdown() {
     assert(state_ != kDisconnected);
@@ -159,16 +401,14 @@ void TcpConnection::forceClose() {
 }
 
 void TcpConnection::stopRead() {
-    loop_->runInLoop([this]() {
-        if (channel_.isReading()) {
-            channel_.disableRead();
-        }
-    });
+    loop_->runInLoop([this]() { pauseRead(kPausedByUser); });
 }
 void TcpConnection::startRead() {
     loop_->runInLoop([this]() {
-        if (!channel_.isReading()) {
-            channel_.enableRead();
+        resumeRead(kPausedByUser);
+        // 输入超限的暂停只在缓冲降到限额以下时解除，这里只把已缓冲的数据再交给回调一次
+        if ((readPaused_ & kPausedByInput) && state_ != kDisconnected) {
+            loop_->queueInLoop(std::bind(&TcpConnection::redeliverInput, shared_from_this()));
         }
     });
 }
@@ -179,25 +419,70 @@ bool TcpConnection::isReading() {
 const Buffer& TcpConnection::inputBuffer() const {
     return inputBuffer_;
 }
-const Buffer& TcpConnection::outputBuffer() const {
+const ChainBuffer& TcpConnection::outputBuffer() const {
     return outputBuffer_;
 }
+size_t TcpConnection::pendingOutputBytes() const {
+    return outputBuffer_.readableBytes() + segmentBytes_;
+}
 
 void TcpConnection::handleRead() {
     loop_->assertInLoopThread();
     assert(state_ != kDisconnected);
-    int savedErrno;
-    ssize_t n = inputBuffer_.readFd(sockfd_, &savedErrno);
-    if (n == -1) {
-        errno = savedErrno;
-        SYSERR("TcpConnection::read()");
-        handleError();
-    }
-    else if (n == 0) {
-        handleClose();
+    // 水平触发下每个可读事件只读一次；边沿触发下必须读到EAGAIN，否则剩余数据不会再有通知
+    for (int reads = 1; ; ++reads) {
+        /**
+         * inputBuffer_中没有遗留数据时读入loop共享的readBuffer并直接交给回调，回调没有消费完的部分再复制到inputBuffer_；
+         * 有遗留数据时读入inputBuffer_，不够的部分溢出到readBuffer。回调消费完之后归还inputBuffer_的存储
+        **/
+        Buffer& readBuffer = loop_->readBuffer();
+        bool shared = inputBuffer_.readableBytes() == 0;
+        Buffer& buffer = shared ? readBuffer : inputBuffer_;
+        int savedErrno;
+        ssize_t n = shared ? readBuffer.readFd(sockfd_, &savedErrno, nullptr, 0)
+                           : inputBuffer_.readFd(sockfd_, &savedErrno, readBuffer.beginWrite(), readBuffer.writableBytes());
+        if (n == -1) {
+            if (edgeTriggered_ && savedErrno == EAGAIN) {
+                break;
+            }
+            errno = savedErrno;
+            SYSERR("TcpConnection::read()");
+            handleError();
+            break;
+        }
+        else if (n == 0) {
+            handleClose();
+            break;
+        }
+        readIdleHook_.lastActive = loop_->now();
+        callbacks_->message(shared_from_this(), buffer);
+        if (shared) {
+            if (readBuffer.readableBytes() > 0 && state_ != kDisconnected) {
+                inputBuffer_.append(readBuffer.peek(), readBuffer.readableBytes());
+            }
+            readBuffer.retrieveAll();
+        }
+        else if (inputBuffer_.readableBytes() == 0) {
+            inputBuffer_.release();
+        }
+        size_t inputLimit = callbacks_->flowControl.inputLimit;
+        if (inputLimit > 0 && inputBuffer_.readableBytes() >= inputLimit && state_ != kDisconnected) {
+            inputLimitReached();
+        }
+        // 回调中可能关闭了连接或暂停了读，重新打开读时epoll_ctl会重新报告就绪状态
+        if (!edgeTriggered_ || state_ == kDisconnected || !channel_.isReading()) {
+            break;
+        }
+        if (reads == kReadBudget) {
+            // 还没有读到EAGAIN，不会再有新的边沿，由任务接着读
+            loop_->queueInLoop(std::bind(&TcpConnection::continueRead, shared_from_this()));
+            break;
+        }
     }
-    else {
-        messageCallback_(shared_from_this(), inputBuffer_);
+}
+void TcpConnection::continueRead() {
+    if (state_ != kDisconnected && channel_.isReading()) {
+        handleRead();
     }
 }
 void TcpConnection::handleWrite() {
@@ -205,22 +490,30 @@ void TcpConnection::handleWrite() {
         WARN("TcpConnection::handleWrite() disconnected, give up writing {} bytes", outputBuffer_.readableBytes());
         return;
     }
-    assert(outputBuffer_.readableBytes() > 0);
     assert(channel_.isWriting());
-    ssize_t n = ::write(sockfd_, outputBuffer_.peek(), outputBuffer_.readableBytes());
-    if (n == -1) {
-        SYSERR("TcpConnection::write()");
+    if (edgeTriggered_) {
+        // 边沿触发下EPOLLOUT常驻，没有待发送数据时的可写通知直接忽略
+        if (!outputPending()) {
+            return;
+        }
     }
-    else {
-        outputBuffer_.retrieve(static_cast<size_t>(n));
-        if (outputBuffer_.readableBytes() == 0) {
-            channel_.disableWrite();
-            if (state_ == kDisconnecting)
-                shutdownInLoop();
-            if (writeCompleteCallback_) {
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+    else assert(outputPending());
+    while (outputPending()) {
+        int savedErrno;
+        ssize_t n = writeOutput(&savedErrno);
+        if (n == -1) {
+            if (savedErrno != EAGAIN) {
+                writeFailed(savedErrno);
             }
+            return;
         }
+        outputWritten();
+        if (!edgeTriggered_) {
+            break; // 水平触发下剩余数据等待下一次可写事件
+        }
+    }
+    if (!outputPending()) {
+        outputDrained();
     }
 }
 void TcpConnection::handleClose() {
@@ -228,14 +521,24 @@ void TcpConnection::handleClose() {
     assert(state_ == kConnected || state_ == kDisconnecting);
     state_ = kDisconnected;
     loop_->removeChannel(&channel_);
-    closeCallback_(shared_from_this());
+    reportOutput();
+    lingerZeroCopy();
+    callbacks_->close(shared_from_this());
 }
 void TcpConnection::handleError() {
+    // 零拷贝的完成通知经错误队列送达，同样以EPOLLERR唤醒
+    if (zeroCopy_ != nullptr) {
+        reapZeroCopyCompletions(sockfd_, *zeroCopy_);
+    }
     int err;
     socklen_t len = sizeof(err);
     int ret = getsockopt(sockfd_, SOL_SOCKET, SO_ERROR, &err, &len);
-    if (ret != -1)
+    if (ret != -1) {
+        if (err == 0 && zeroCopy_ != nullptr) {
+            return;
+        }
         errno = err;
+    }
     SYSERR("TcpConnection::handleError()");
 }
 
@@ -252,7 +555,7 @@ void TcpConnection::sendInLoop(const char *data, size_t len) {
      * 如果已经在监听EPOLLOUT事件了，说明sockfd_内核缓冲区已经是已满状态，因此就不会尝试执行write
      * 的操作，而是直接执行下面的逻辑，将待发送数据追加到outputBuffer_ 
     **/
-    if (!channel_.isWriting()) {
+    if (!corked_ && !writePending()) {
         assert(outputBuffer_.readableBytes() == 0);
         n = ::write(sockfd_, data, len);
         if (n == -1) {
@@ -264,10 +567,11 @@ void TcpConnection::sendInLoop(const char *data, size_t len) {
             n = 0;
         }
         else {
+            writeIdleHook_.lastActive = loop_->now();
             remain -= static_cast<size_t>(n);
-            if (remain == 0 && writeCompleteCallback_) {
+            if (remain == 0 && callbacks_->writeComplete) {
                 // 正常写完了，执行写完成回调
-                loop_->queueInLoop(std::bind(writeCompleteCallback_, shared_from_this()));
+                loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
             }
         }
     }
@@ -278,24 +582,431 @@ void TcpConnection::sendInLoop(const char *data, size_t len) {
      * 缓冲区写入
     **/
     if (!faultError && remain > 0) {
-        if (highWaterMarkCallback_) {
+        if (callbacks_->highWaterMark) {
+            size_t mark = callbacks_->highWaterMarkBytes;
             size_t oldLen = outputBuffer_.readableBytes();
             size_t newLen = oldLen + remain;
-            if (oldLen < highWaterMark_ && newLen >= highWaterMark_)
+            if (oldLen < mark && newLen >= mark)
                 loop_->queueInLoop(std::bind(
-                        highWaterMarkCallback_, shared_from_this(), newLen));
+                        callbacks_->highWaterMark, shared_from_this(), newLen));
         }
         outputBuffer_.append(data + n, remain);
-        channel_.enableWrite();
+        outputQueued();
     }
 }
 void TcpConnection::sendInLoop(const std::string& message) {
     sendInLoop(message.data(), message.length());
 }
+void TcpConnection::sendInLoop(const struct iovec* iov, int iovcnt) {
+    loop_->assertInLoopThread();
+    if (state_ == kDisconnected) {
+        WARN("TcpConnection::sendInLoop() disconnected, give up send");
+        return;
+    }
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        len += iov[i].iov_len;
+    }
+    size_t written = 0;
+    bool faultError = false;
+    // 与单段的sendInLoop相同，只是用一次writev代替write
+    if (!corked_ && !writePending() && len > 0) {
+        assert(outputBuffer_.readableBytes() == 0);
+        ssize_t n = ::writev(sockfd_, iov, std::min(iovcnt, IOV_MAX));
+        if (n == -1) {
+            if (errno != EAGAIN) {
+                SYSERR("TcpConnection::writev()");
+                if (errno == EPIPE || errno == ECONNRESET)
+                    faultError = true;
+            }
+        }
+        else {
+            writeIdleHook_.lastActive = loop_->now();
+            written = static_cast<size_t>(n);
+            if (written == len && callbacks_->writeComplete) {
+                loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
+            }
+        }
+    }
+    if (!faultError && written < len) {
+        size_t remain = len - written;
+        if (callbacks_->highWaterMark) {
+            size_t mark = callbacks_->highWaterMarkBytes;
+            size_t oldLen = outputBuffer_.readableBytes();
+            size_t newLen = oldLen + remain;
+            if (oldLen < mark && newLen >= mark)
+                loop_->queueInLoop(std::bind(
+                        callbacks_->highWaterMark, shared_from_this(), newLen));
+        }
+        // 跳过已经写出的部分，剩余各段直接追加，不经过中间拼接
+        for (int i = 0; i < iovcnt; ++i) {
+            const char* base = static_cast<const char*>(iov[i].iov_base);
+            size_t pieceLen = iov[i].iov_len;
+            if (written >= pieceLen) {
+                written -= pieceLen;
+                continue;
+            }
+            outputBuffer_.append(base + written, pieceLen - written);
+            written = 0;
+        }
+        outputQueued();
+    }
+}
+void TcpConnection::sendFileInLoop(const FileHandlePtr& file, off_t offset, size_t length) {
+    loop_->assertInLoopThread();
+    if (state_ == kDisconnected) {
+        WARN("TcpConnection::sendFileInLoop() disconnected, give up send");
+        return;
+    }
+    size_t remain = length;
+    bool faultError = false;
+    // 前面没有排队的数据时直接发送，与sendInLoop相同
+    if (!corked_ && !writePending() && remain > 0) {
+        ssize_t n = ::sendfile(sockfd_, file->fd(), &offset, remain);
+        if (n == -1) {
+            if (errno != EAGAIN) {
+                // 文件或socket出错，之后的数据无法再按序发送
+                SYSERR("TcpConnection::sendfile()");
+                faultError = true;
+                forceClose();
+            }
+        }
+        else {
+            writeIdleHook_.lastActive = loop_->now();
+            remain -= static_cast<size_t>(n);
+            if (n == 0) {
+                // 文件比length短，剩余部分无法发送
+                ERROR("TcpConnection::sendFileInLoop() unexpected end of file, {} bytes not sent", remain);
+                faultError = true;
+            }
+            else if (remain == 0 && callbacks_->writeComplete) {
+                loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
+            }
+        }
+    }
+    if (!faultError && remain > 0) {
+        queueSegment(Segment{file, nullptr, nullptr, offset, remain, 0});
+    }
+}
+void TcpConnection::sendZeroCopyInLoop(const char* data, size_t len, const std::shared_ptr<const void>& holder) {
+    loop_->assertInLoopThread();
+    if (zeroCopy_ == nullptr || len < zeroCopy_->threshold) {
+        sendInLoop(data, len);
+        return;
+    }
+    if (state_ == kDisconnected) {
+        WARN("TcpConnection::sendZeroCopyInLoop() disconnected, give up send");
+        return;
+    }
+    size_t remain = len;
+    bool faultError = false;
+    if (!corked_ && !writePending()) {
+        ssize_t n = sendZeroCopyOnce(data, len, holder);
+        if (n == -1) {
+            // ENOBUFS表示超出了锁定内存的限额，排队等待可写事件时再试
+            if (errno != EAGAIN && errno != ENOBUFS) {
+                SYSERR("TcpConnection::sendZeroCopy()");
+                if (errno == EPIPE || errno == ECONNRESET)
+                    faultError = true;
+            }
+        }
+        else {
+            writeIdleHook_.lastActive = loop_->now();
+            remain -= static_cast<size_t>(n);
+            if (remain == 0 && callbacks_->writeComplete) {
+                loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
+            }
+        }
+    }
+    if (!faultError && remain > 0) {
+        queueSegment(Segment{nullptr, holder, data + (len - remain), 0, remain, 0});
+    }
+}
+
+ssize_t TcpConnection::sendZeroCopyOnce(const char* data, size_t len, const std::shared_ptr<const void>& holder) {
+    ssize_t n = ::send(sockfd_, data, len, MSG_ZEROCOPY);
+    if (n > 0) {
+        // 内核为每次成功的零拷贝发送分配一个递增的序号，同一块内存的多次发送只保留最后一个
+        uint32_t id = zeroCopy_->nextId++;
+        auto& inflight = zeroCopy_->inflight;
+        if (!inflight.empty() && inflight.back().holder == holder) {
+            inflight.back().lastId = id;
+        }
+        else inflight.push_back(ZeroCopyInflight{id, holder});
+    }
+    return n;
+}
+
+void TcpConnection::queueSegment(Segment&& segment) {
+    size_t queued = 0;
+    for (const auto& pending : pendingSegments_) {
+        queued += pending.bytesBefore;
+    }
+    segment.bytesBefore = outputBuffer_.readableBytes() - queued;
+    segmentBytes_ += segment.remaining;
+    pendingSegments_.push_back(std::move(segment));
+    outputQueued();
+}
+
+void TcpConnection::outputQueued() {
+    reportOutput();
+    size_t highWater = callbacks_->flowControl.outputHighWater;
+    if (highWater > 0 && outputBuffer_.readableBytes() >= highWater) {
+        pauseRead(kPausedByOutput);
+    }
+    if (corked_) {
+        // 本轮结束时统一写出；socket已满时等待可写事件即可
+        loop_->countCorkedSend();
+        if (!flushQueued_ && (edgeTriggered_ || !channel_.isWriting())) {
+            flushQueued_ = true;
+            loop_->runAfterIteration([ptr = shared_from_this()]() { ptr->flushOutput(); });
+        }
+    }
+    else if (!edgeTriggered_ && !channel_.isWriting()) {
+        channel_.enableWrite();
+    }
+}
+
+void TcpConnection::flushOutput() {
+    flushQueued_ = false;
+    if (state_ == kDisconnected || !outputPending() || (!edgeTriggered_ && channel_.isWriting())) {
+        return;
+    }
+    while (outputPending()) {
+        int savedErrno;
+        ssize_t n = writeOutput(&savedErrno);
+        loop_->countCorkedWrite();
+        if (n == -1) {
+            if (savedErrno != EAGAIN) {
+                writeFailed(savedErrno);
+                return;
+            }
+            break;
+        }
+        outputWritten();
+        // 水平触发下只写到socket缓冲区满为止，剩余数据等待可写事件；边沿触发下要写到EAGAIN
+        if (!edgeTriggered_ && pendingSegments_.empty() && outputBuffer_.readableBytes() > 0) {
+            break;
+        }
+    }
+    if (!outputPending()) {
+        outputDrained();
+    }
+    else if (!edgeTriggered_) {
+        channel_.enableWrite();
+    }
+}
+
+void TcpConnection::outputWritten() {
+    writeIdleHook_.lastActive = loop_->now();
+    reportOutput();
+    if ((readPaused_ & kPausedByOutput) && outputBuffer_.readableBytes() <= callbacks_->flowControl.outputLowWater) {
+        resumeRead(kPausedByOutput);
+    }
+}
+
+void TcpConnection::reportOutput() {
+    size_t pending = state_ == kDisconnected ? 0 : pendingOutputBytes();
+    if (pending > reportedOutput_) {
+        loop_->addQueuedOutput(pending - reportedOutput_);
+    }
+    else if (pending < reportedOutput_) {
+        loop_->removeQueuedOutput(reportedOutput_ - pending);
+    }
+    reportedOutput_ = pending;
+}
+
+void TcpConnection::pauseRead(uint8_t reason) {
+    readPaused_ = static_cast<uint8_t>(readPaused_ | reason);
+    if (channel_.isReading()) {
+        channel_.disableRead();
+    }
+}
+
+void TcpConnection::resumeRead(uint8_t reasons) {
+    readPaused_ = static_cast<uint8_t>(readPaused_ & ~reasons);
+    if (readPaused_ == 0 && !channel_.isReading() && state_ != kDisconnected) {
+        channel_.enableRead();
+    }
+}
+
+void TcpConnection::inputLimitReached() {
+    const FlowControl& flowControl = callbacks_->flowControl;
+    if (flowControl.inputPolicy == InputLimitPolicy::kClose) {
+        WARN("TcpConnection {} unconsumed input {} bytes exceeds limit {}, close", name(),
+             inputBuffer_.readableBytes(), flowControl.inputLimit);
+        handleClose();
+        return;
+    }
+    // 停止从socket读取，把已经缓冲的数据再交给回调处理，直到降到限额以下
+    if (!(readPaused_ & kPausedByInput)) {
+        pauseRead(kPausedByInput);
+        loop_->queueInLoop(std::bind(&TcpConnection::redeliverInput, shared_from_this()));
+    }
+}
+
+void TcpConnection::redeliverInput() {
+    if (state_ == kDisconnected || !(readPaused_ & kPausedByInput)) {
+        return;
+    }
+    size_t before = inputBuffer_.readableBytes();
+    callbacks_->message(shared_from_this(), inputBuffer_);
+    if (state_ == kDisconnected) {
+        return;
+    }
+    size_t after = inputBuffer_.readableBytes();
+    // 有进展就继续处理已缓冲的数据，处理完或者不再有进展时，降到限额以下才恢复读取
+    if (after > 0 && after < before) {
+        loop_->queueInLoop(std::bind(&TcpConnection::redeliverInput, shared_from_this()));
+    }
+    else if (after < callbacks_->flowControl.inputLimit) {
+        if (after == 0) {
+            inputBuffer_.release();
+        }
+        resumeRead(kPausedByInput);
+    }
+    // 回调没有消费任何数据且仍然超限时保持暂停，应用调用startRead时再投递一次
+}
+
+void TcpConnection::outputDrained() {
+    outputBuffer_.release(); // 发送完毕的连接不再占用写缓冲区
+    if (!edgeTriggered_ && channel_.isWriting()) {
+        channel_.disableWrite();
+    }
+    if (state_ == kDisconnecting)
+        shutdownInLoop();
+    if (callbacks_->writeComplete) {
+        loop_->queueInLoop(std::bind(callbacks_->writeComplete, shared_from_this()));
+    }
+}
+
+void TcpConnection::reapZeroCopyCompletions(int fd, ZeroCopyState& state) {
+    auto& inflight = state.inflight;
+    char control[128];
+    while (true) {
+        struct msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+            if (errno != EAGAIN) {
+                SYSERR("TcpConnection::recvmsg(MSG_ERRQUEUE)");
+            }
+            break;
+        }
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            bool recvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                           (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!recvErr) {
+                continue;
+            }
+            struct sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // 通知[ee_info, ee_data]区间内的发送已经完成，TCP的通知按序到达
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                state.copied += err.ee_data - err.ee_info + 1;
+            }
+            while (!inflight.empty() && static_cast<int32_t>(inflight.front().lastId - err.ee_data) <= 0) {
+                inflight.pop_front();
+            }
+        }
+    }
+}
+
+void TcpConnection::lingerZeroCopy() {
+    if (zeroCopy_ == nullptr) {
+        return;
+    }
+    reapZeroCopyCompletions(sockfd_, *zeroCopy_);
+    if (zeroCopy_->inflight.empty()) {
+        return;
+    }
+    // 连接析构时关闭sockfd_，复制出的fd让socket继续存在，内核才能把数据发完并送回完成通知
+    int fd = ::fcntl(sockfd_, F_DUPFD_CLOEXEC, 0);
+    if (fd == -1) {
+        SYSERR("TcpConnection::lingerZeroCopy()");
+        return;
+    }
+    // 对端照常在数据之后收到FIN，就像sockfd_被关闭了一样
+    ::shutdown(fd, SHUT_WR);
+    auto parked = std::make_shared<ZeroCopyLinger>();
+    parked->fd = fd;
+    parked->state.inflight = std::move(zeroCopy_->inflight);
+    zeroCopy_->inflight.clear();
+    loop_->linger([parked]() {
+        reapZeroCopyCompletions(parked->fd, parked->state);
+        return parked->state.inflight.empty();
+    }, kZeroCopyLinger);
+}
+
+TcpConnection::ZeroCopyLinger::~ZeroCopyLinger() {
+    if (!state.inflight.empty()) {
+        // 超时仍未完成：中止连接，内核丢弃发送队列，不再发送这些内存中的数据
+        struct linger abortive = {1, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_LINGER, &abortive, sizeof(abortive));
+    }
+    ::close(fd);
+}
+
+ssize_t TcpConnection::writeOutput(int* savedErrno) {
+    // 一次writev写出链上的多个块，已写出的块随即释放
+    if (pendingSegments_.empty()) {
+        return outputBuffer_.writeFd(sockfd_, savedErrno);
+    }
+    Segment& segment = pendingSegments_.front();
+    if (segment.bytesBefore > 0) {
+        ssize_t n = outputBuffer_.writeFd(sockfd_, savedErrno, segment.bytesBefore);
+        if (n > 0) {
+            segment.bytesBefore -= static_cast<size_t>(n);
+        }
+        return n;
+    }
+    ssize_t n;
+    if (segment.file != nullptr) {
+        n = ::sendfile(sockfd_, segment.file->fd(), &segment.offset, segment.remaining);
+    }
+    else {
+        n = sendZeroCopyOnce(segment.data, segment.remaining, segment.pinned);
+    }
+    if (n == -1) {
+        // ENOBUFS时等待完成通知释放锁定的内存，之后的可写事件中再试
+        *savedErrno = errno == ENOBUFS ? EAGAIN : errno;
+        return n;
+    }
+    segment.remaining -= static_cast<size_t>(n);
+    segment.data += n;
+    segmentBytes_ -= static_cast<size_t>(n);
+    if (n == 0) {
+        ERROR("TcpConnection::writeOutput() unexpected end of file, {} bytes not sent", segment.remaining);
+        segmentBytes_ -= segment.remaining;
+        segment.remaining = 0;
+    }
+    if (segment.remaining == 0) {
+        pendingSegments_.pop_front();
+    }
+    return n;
+}
+
+void TcpConnection::writeFailed(int savedErrno) {
+    errno = savedErrno;
+    SYSERR("TcpConnection::write()");
+    /**
+     * 出错的数据仍在队首，水平触发下EPOLLOUT会一直触发；sendfile读文件出错（EINVAL、EIO）时socket本身完好，
+     * 也不会等到挂断事件。之后的数据已无法按序发送，直接关闭连接
+    **/
+    forceClose();
+}
+
+bool TcpConnection::outputPending() const {
+    return outputBuffer_.readableBytes() > 0 || !pendingSegments_.empty();
+}
 
 void TcpConnection::shutdownInLoop() {
     loop_->assertInLoopThread();
-    if (state_ != kDisconnected && !channel_.isWriting()) {
+    // 合并写模式下数据可能还在等待本轮结束时的写出
+    if (state_ != kDisconnected && !outputPending()) {
         if (::shutdown(sockfd_, SHUT_WR) == -1) {
             SYSERR("TcpConnection::shutdown()");
         }
@@ -308,6 +1019,11 @@ void TcpConnection::forceCloseInLoop() {
     }
 }
 
+bool TcpConnection::writePending() const {
+    // 边沿触发下EPOLLOUT常驻，不能再用isWriting()判断是否有未发送完的数据
+    return edgeTriggered_ ? outputPending() : channel_.isWriting();
+}
+
 int TcpConnection::stateAtomicGetAndSet(int newState) {
     return __atomic_exchange_n(&state_, newState, __ATOMIC_SEQ_CST); // 顺序一致性内存序
 }
\ No newline at end of file
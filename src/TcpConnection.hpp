@@ -1,12 +1,19 @@
 #pragma once
 
-#include <any>
+#include <deque>
+#include <list>
+#include <span>
+#include <string_view>
+#include <sys/uio.h>
 
 #include "noncopyable.hpp"
 #include "Callbacks.hpp"
 #include "Channel.hpp"
 #include "InetAddress.hpp"
 #include "Buffer.hpp"
+#include "ChainBuffer.hpp"
+#include "IdleWheel.hpp"
+#include "FileCache.hpp"
 
 namespace mudong {
 
@@ -14,18 +21,72 @@ namespace ev {
 
 class EventLoop;
 
+// 回调没有消费的输入超过限额时的处理方式
+enum class InputLimitPolicy {
+    kPauseRead,
+    kClose
+};
+
+/**
+ * 连接的双向流控，各项为0表示不限制。outputBuffer_积压到outputHighWater时暂停读取，写出到
+ * 不超过outputLowWater时恢复；回调没有消费的输入达到inputLimit时按inputPolicy暂停读取或关闭连接
+**/
+struct FlowControl {
+    size_t outputHighWater = 0;
+    size_t outputLowWater = 0;
+    size_t inputLimit = 0;
+    InputLimitPolicy inputPolicy = InputLimitPolicy::kPauseRead;
+};
+
+/**
+ * 连接上层回调的只读表。同一个TcpServerSingle（或TcpClient）的所有连接共享一张表，
+ * 每个连接只保存一个shared_ptr，而不是各自持有几份std::function的拷贝
+**/
+struct TcpConnectionCallbacks {
+    MessageCallback message;
+    WriteCompleteCallback writeComplete;
+    HighWaterMarkCallback highWaterMark;
+    size_t highWaterMarkBytes = 0;
+    CloseCallback close;
+    FlowControl flowControl;
+};
+
+using TcpConnectionCallbacksPtr = std::shared_ptr<const TcpConnectionCallbacks>;
+
 class TcpConnection: noncopyable, public std::enable_shared_from_this<TcpConnection>
 {
 public:
+    // 默认的零拷贝阈值，更小的数据拷贝的开销低于页面锁定与完成通知的开销
+    static const size_t kZeroCopyThreshold = 64 * 1024;
+
     TcpConnection(EventLoop* loop, int sockfd, const InetAddress& local, const InetAddress& peer);
     ~TcpConnection();
 
+    // 替换整张回调表。下面几个单项的setter会先复制一份当前的表再修改，只影响本连接
+    void setCallbacks(const TcpConnectionCallbacksPtr& callbacks);
     void setMessageCallback(const MessageCallback& callback);
     void setWriteCompleteCallback(const WriteCompleteCallback& callback);
     void setHighWaterMarkCallback(const HighWaterMarkCallback& callback, size_t mark);
     void setCloseCallback(const CloseCallback& callback);
+    /**
+     * 开启流控后读取的暂停与恢复由连接自己管理，与stopRead/startRead互不覆盖：只有所有原因都解除后才恢复读取。
+     * 输入超限而暂停时，已缓冲的数据会在之后的任务中继续交给消息回调，降到限额以下后恢复读取
+    **/
+    void setFlowControl(const FlowControl& flowControl);
+    // 在connectEstablished之前调用。边沿触发下读写都循环到EAGAIN，EPOLLOUT常驻注册，
+    // 省去每次写缓冲区填满与清空时的epoll_ctl；Poller不支持时保持水平触发
+    void setEdgeTriggered(bool on);
+    bool edgeTriggered() const;
+    /**
+     * 合并写：开启后send只把数据追加到outputBuffer_，本轮事件与任务处理完之后每个连接一次writev写出，
+     * 一个回调中的多次send因此只有一次系统调用。只能在loop线程中调用，关闭时立即写出已积累的数据
+    **/
+    void setCorked(bool on);
+    bool corked() const;
 
     void connectEstablished();
+    // 所属loop退出后由TcpServerSingle或TcpClient在loop线程中调用，不经过close回调直接断开
+    void connectDestroyed();
     bool connected() const;
     bool disconnected() const;
 
@@ -33,51 +94,231 @@ public:
     const InetAddress& peer() const;
     std::string name() const;
 
-    void setContext(const std::any& context);
-    const std::any& getContext() const;
-    std::any& getContext();
+    /**
+     * 上下文槽只保存一个指针和它的类型标记，不分配内存。与原先的std::any不同，连接不拥有所指对象，
+     * 其生命周期由使用者管理，连接销毁时也不会释放。按与setContext不同的类型读取时返回nullptr
+    **/
+    template <typename T>
+    void setContext(T* context) {
+        context_ = context;
+        contextType_ = contextTag<T>();
+    }
+    template <typename T>
+    T* getContext() const {
+        if (contextType_ != contextTag<T>()) {
+            return nullptr;
+        }
+        return static_cast<T*>(context_);
+    }
 
     void send(std::string_view data);
+    void send(const char* data);
     void send(const char* data, size_t len);
     void send(Buffer& buffer);
+    /**
+     * 在其他线程中调用时直接把数据的所有权转移给loop，不再拷贝。
+     * Buffer&&转移的是存储本身，原缓冲区变为空并保留所属的池
+    **/
+    void send(std::string&& data);
+    void send(Buffer&& buffer);
+    // 同一份数据发给多个连接时共享，不拷贝；开启了零拷贝且足够大时以MSG_ZEROCOPY发送
+    void send(const std::shared_ptr<const std::string>& data);
+    /**
+     * 按顺序发送多段数据，不需要先拼接：没有排队数据时一次writev写出，没写完的部分逐段追加到outputBuffer_。
+     * 在其他线程中调用时各段拷贝进同一个字符串再交给loop
+    **/
+    void send(std::span<const std::string_view> pieces);
+    void send(const struct iovec* iov, int iovcnt);
+
+    /**
+     * 用sendfile(2)发送文件中[offset, offset + length)的内容，数据不经过用户态。
+     * 与send的数据按调用顺序发送，socket缓冲区满时排队，等待可写事件后继续。
+     * fd在调用返回后即可关闭（内部dup了一份）；可以在任意线程中调用。
+     * fd不是普通文件或块设备（sendfile不能从管道、socket读取）时返回false；
+     * 之后读文件出错（如EIO）时之后的数据已无法按序发送，连接随即关闭，由关闭回调通知应用
+    **/
+    bool sendFile(int fd, off_t offset, size_t length);
+    void sendFile(const FileHandlePtr& file, off_t offset, size_t length);
+    /**
+     * 按路径发送，所在loop开启了FileCache时复用已打开的fd，length为0表示发送到文件末尾。
+     * 只能在loop线程中调用（例如消息回调中），打开失败返回false
+    **/
+    bool sendFile(const std::string& path, off_t offset = 0, size_t length = 0);
+
+    /**
+     * 开启MSG_ZEROCOPY发送：不小于threshold字节的sendZeroCopy直接从调用者的内存发送，
+     * 内核经MSG_ERRQUEUE通知发送完成之前，本连接一直持有这块内存的引用；更小的数据照常拷贝发送。
+     * 连接断开时还没有完成的引用转交给所在的loop，完成之后或者超时中止连接之后才释放。
+     * 只能在loop线程中调用，内核或socket不支持时返回false
+    **/
+    bool enableZeroCopy(size_t threshold = kZeroCopyThreshold);
+    bool zeroCopyEnabled() const;
+    // 已经交给内核、尚未收到完成通知的零拷贝发送次数
+    size_t zeroCopyInflight() const;
+    // 内核没有真正零拷贝、而是退回拷贝的发送次数，例如经过loopback的连接
+    uint64_t zeroCopyCopied() const;
+
+    // holder持有[data, data + len)所在的内存，未开启零拷贝时退化为send。写完成回调不等待完成通知
+    void sendZeroCopy(const char* data, size_t len, std::shared_ptr<const void> holder);
+    void sendZeroCopy(const std::shared_ptr<const std::string>& data);
 
     void shutdown(); // 半关闭，关闭服务端写，保留读
     void forceClose();
 
+    // startRead只解除stopRead的暂停，流控因输入超限或输出积压的暂停仍然有效；
+    // 输入超限而暂停时会把已缓冲的数据再交给消息回调，降到限额以下才恢复读取
     void stopRead();
     void startRead();
     bool isReading();
 
+    // 上一次消息回调没有消费完、留待下次处理的数据；回调中的数据可能在loop共享的读缓冲区中
     const Buffer& inputBuffer() const;
-    const Buffer& outputBuffer() const;
+    /**
+     * 待发送的数据。与inputBuffer不同，返回的是ChainBuffer而不是Buffer：没有findCRLF/findEOL等查找接口，
+     * 数据可能跨越多个块，peek()只返回头块中连续的contiguousBytes()字节。需要整段内容时用copyOut或fillIovec
+    **/
+    const ChainBuffer& outputBuffer() const;
+    // outputBuffer_与排队的文件、零拷贝段中还没有写出的字节数
+    size_t pendingOutputBytes() const;
 
 private:
+    friend class IdleWheel;
+
+    static const Channel::Handlers kChannelHandlers;
+    // 边沿触发下每个可读事件最多读取的次数，用完后排到本轮任务中继续，避免一个连接独占loop
+    static const int kReadBudget = 16;
+
+    // 每种上下文类型一个唯一的地址，作为上下文槽的类型标记
+    template <typename T>
+    static const void* contextTag() {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    // 暂停读取的原因，可以同时存在
+    enum PauseReason : uint8_t {
+        kPausedByUser = 1,
+        kPausedByOutput = 2,
+        kPausedByInput = 4
+    };
+
+    /**
+     * 不经过outputBuffer_的排队数据：file不为空时是sendFile的文件，否则是零拷贝发送的内存，由pinned持有。
+     * bytesBefore为它与前一段之间outputBuffer_中的数据量，这些数据要先发送
+    **/
+    struct Segment {
+        FileHandlePtr file;
+        std::shared_ptr<const void> pinned;
+        const char* data;
+        off_t offset;
+        size_t remaining;
+        size_t bytesBefore;
+    };
+    // 等待完成通知的零拷贝发送，lastId为这块内存最后一次发送的通知序号
+    struct ZeroCopyInflight {
+        uint32_t lastId;
+        std::shared_ptr<const void> holder;
+    };
+    struct ZeroCopyState {
+        size_t threshold;
+        uint32_t nextId;
+        uint64_t copied;
+        std::deque<ZeroCopyInflight> inflight;
+    };
+    // 连接关闭时还没有完成的零拷贝发送，连同复制出的socket交给loop保留，析构时关闭socket
+    struct ZeroCopyLinger {
+        int fd;
+        ZeroCopyState state;
+        ~ZeroCopyLinger();
+    };
+    // 关闭后最多等待完成通知的时长，超时则中止连接
+    static constexpr Nanoseconds kZeroCopyLinger = Seconds(10);
+
+    // 写时复制：返回本连接独占的回调表
+    TcpConnectionCallbacks& mutableCallbacks();
+
     void handleRead();
+    // 读取预算用完之后排队继续读，期间连接可能已经关闭或暂停读
+    void continueRead();
     void handleWrite();
     void handleClose();
     void handleError();
 
     void sendInLoop(const char* data, size_t len);
     void sendInLoop(const std::string& message);
+    void sendInLoop(const struct iovec* iov, int iovcnt);
+    void sendFileInLoop(const FileHandlePtr& file, off_t offset, size_t length);
+    // 写出失败（不是EAGAIN）时记录错误并关闭连接
+    void writeFailed(int savedErrno);
+    void sendZeroCopyInLoop(const char* data, size_t len, const std::shared_ptr<const void>& holder);
+    // 以MSG_ZEROCOPY发送一次，成功时记录完成通知的序号，在通知到达前持有holder
+    ssize_t sendZeroCopyOnce(const char* data, size_t len, const std::shared_ptr<const void>& holder);
+    // 把remaining字节排在已有的待发送数据之后，等待可写事件
+    void queueSegment(Segment&& segment);
+    // 数据进入outputBuffer_或排队之后：合并写模式下登记本轮结束时的写出，否则关注可写事件
+    void outputQueued();
+    // 合并写模式下本轮结束时调用，写出积累的数据
+    void flushOutput();
+    // 写出数据之后：刷新写空闲时间，积压降到低水位以下时恢复读取
+    void outputWritten();
+    // 把待发送字节数的变化计入loop的总量，断开后按0计
+    void reportOutput();
+    void pauseRead(uint8_t reason);
+    void resumeRead(uint8_t reasons);
+    // 回调没有消费的输入达到限额
+    void inputLimitReached();
+    // 输入超限暂停期间，把缓冲的数据再次交给消息回调
+    void redeliverInput();
+    // 待发送数据全部写完：归还写缓冲区，完成半关闭，通知写完成
+    void outputDrained();
+    // 读出fd上MSG_ERRQUEUE中所有的完成通知，释放已完成的内存
+    static void reapZeroCopyCompletions(int fd, ZeroCopyState& state);
+    /**
+     * 连接断开时内核可能还在发送零拷贝的数据：复制一份socket并半关闭，未完成的内存交给loop保留，
+     * 完成通知全部到达或超过kZeroCopyLinger之后才释放，不随连接析构
+    **/
+    void lingerZeroCopy();
+    // 按顺序写出一段待发送数据：下一个排队段之前的缓冲数据，或者排队段本身。返回写出的字节数，出错返回-1
+    ssize_t writeOutput(int* savedErrno);
+    // outputBuffer_或pendingSegments_中是否还有数据
+    bool outputPending() const;
     void shutdownInLoop();
     void forceCloseInLoop();
 
     int stateAtomicGetAndSet(int newState);
+    // 是否还有待发送的数据，此时新的数据只能排在后面
+    bool writePending() const;
 
     EventLoop* loop_;
     const int sockfd_;
-    Channel channel_;
     int state_;
+    bool edgeTriggered_;
+    bool corked_;
+    // 本轮已经登记过写出
+    bool flushQueued_;
+    // PauseReason的组合，为0时才读取
+    uint8_t readPaused_;
+    Channel channel_;
     InetAddress local_;
     InetAddress peer_;
+    // 两个缓冲区的存储来自所在loop的内存池，持有引用使池比缓冲区活得更久，因此要声明在缓冲区之前
+    std::shared_ptr<BufferPool> bufferPool_;
     Buffer inputBuffer_;
-    Buffer outputBuffer_;
-    size_t highWaterMark_;
-    std::any context_;
-    MessageCallback messageCallback_;
-    WriteCompleteCallback writeCompleteCallback_;
-    HighWaterMarkCallback highWaterMarkCallback_;
-    CloseCallback closeCallback_;
+    // 由固定大小的块串成，对端读得慢时堆积的数据不会因扩容而反复拷贝
+    ChainBuffer outputBuffer_;
+    std::list<Segment> pendingSegments_;
+    // pendingSegments_中剩余的字节数
+    size_t segmentBytes_;
+    // 上一次计入loop的待发送字节数
+    size_t reportedOutput_;
+    // 开启零拷贝时才分配，不使用的连接只多一个指针
+    std::unique_ptr<ZeroCopyState> zeroCopy_;
+    void* context_;
+    const void* contextType_;
+    // 最近一次读到或写出数据的时刻由这里记录，由所在loop的IdleWheel检查
+    IdleHook readIdleHook_;
+    IdleHook writeIdleHook_;
+    TcpConnectionCallbacksPtr callbacks_;
 };
 
 } // namespace ev
@@ -1,17 +1,32 @@
 #include "TcpServer.hpp"
 #include "Logger.hpp"
 #include "EventLoop.hpp"
+#include "ThreadPlacement.hpp"
+
+#include <algorithm>
 
 using namespace mudong::ev;
 
 TcpServer::TcpServer(EventLoop* loop, const InetAddress& local)
         : baseLoop_(loop),
           numThreads_(1),
+          pollerType_(Poller::defaultType()),
+          spinBudget_(Nanoseconds::zero()),
+          socketBusyPollUs_(0),
+          hugePageBuffers_(false),
+          edgeTriggered_(false),
+          corked_(false),
+          acceptBatch_(Acceptor::kDefaultAcceptBatch),
+          cpuAffinity_(false),
+          numaLocal_(false),
+          readIdleTimeout_(Nanoseconds::zero()),
+          writeIdleTimeout_(Nanoseconds::zero()),
           started_(false),
           local_(local),
           threadInitCallback_(defaultThreadInitCallback),
           connectionCallback_(defaultConnectionCallback),
-          messageCallback_(defaultMessageCallback)
+          messageCallback_(defaultMessageCallback),
+          idleCallback_(defaultIdleCallback)
 {
     INFO("create TcpServer {}", local.toIpPort());
 }
@@ -33,12 +48,110 @@ void TcpServer::setNumThread(size_t n) {
     if (n > 0) {
         numThreads_ = n;
         eventLoops_.resize(n);
+        servers_.resize(n);
     }
     else {
         ERROR("TcpServer::setNumThread n <= 0");
     }
 }
 
+void TcpServer::setPollerType(Poller::Type type) {
+    assert(!started_);
+    pollerType_ = type;
+}
+
+void TcpServer::setBusyPoll(Nanoseconds spinBudget, int socketBusyPollUs) {
+    assert(!started_);
+    spinBudget_ = spinBudget;
+    socketBusyPollUs_ = socketBusyPollUs;
+}
+
+void TcpServer::setHugePageBuffers(bool on) {
+    assert(!started_);
+    hugePageBuffers_ = on;
+}
+
+void TcpServer::setEdgeTriggered(bool on) {
+    assert(!started_);
+    edgeTriggered_ = on;
+}
+
+void TcpServer::setCorked(bool on) {
+    assert(!started_);
+    corked_ = on;
+}
+
+void TcpServer::setFlowControl(const FlowControl& flowControl) {
+    assert(!started_);
+    assert(flowControl.outputLowWater <= flowControl.outputHighWater);
+    flowControl_ = flowControl;
+}
+
+void TcpServer::setAcceptBatch(int batch) {
+    assert(!started_);
+    assert(batch > 0);
+    acceptBatch_ = batch;
+}
+
+void TcpServer::setCpuAffinity(bool on) {
+    assert(!started_);
+    cpuAffinity_ = on;
+}
+
+void TcpServer::setThreadPlacement(const ThreadPlacementCallback& callback) {
+    assert(!started_);
+    threadPlacement_ = callback;
+}
+
+void TcpServer::setNumaLocal(bool on) {
+    assert(!started_);
+    numaLocal_ = on;
+}
+
+void TcpServer::setLoadBalancer(const LoadBalancer& balancer) {
+    assert(!started_);
+    loadBalancer_ = balancer;
+}
+
+Acceptor::Stats TcpServer::acceptStats() {
+    Acceptor::Stats total = {0, 0, 0};
+    auto add = [&total](const Acceptor::Stats& stats) {
+        total.accepted += stats.accepted;
+        total.rejected += stats.rejected;
+        total.acceptRate += stats.acceptRate;
+    };
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (acceptor_ != nullptr) {
+        add(acceptor_->stats());
+    }
+    for (auto server : servers_) {
+        if (server != nullptr) {
+            add(server->acceptStats());
+        }
+    }
+    return total;
+}
+
+std::vector<size_t> TcpServer::connectionCounts() {
+    std::vector<size_t> counts;
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto server : servers_) {
+        counts.push_back(server != nullptr ? server->connectionCount() : 0);
+    }
+    return counts;
+}
+
+void TcpServer::setIdleTimeout(Nanoseconds readIdle, Nanoseconds writeIdle) {
+    assert(!started_);
+    readIdleTimeout_ = readIdle;
+    writeIdleTimeout_ = writeIdle;
+}
+
+void TcpServer::setIdleCallback(const IdleCallback& callback) {
+    assert(!started_);
+    idleCallback_ = callback;
+}
+
 void TcpServer::start() {
     if (started_.exchange(true)) return;
 
@@ -59,16 +172,46 @@ void TcpServer::setWriteCompleteCallback(const WriteCompleteCallback& callback)
 }
 
 void TcpServer::startInLoop() {
-    INFO("TcpServer::start() {} with {} eventLoop thread(s)", local_.toIpPort(), numThreads_);
+    INFO("TcpServer::start() {} with {} eventLoop thread(s), poller {}", local_.toIpPort(), numThreads_, Poller::typeName(pollerType_));
 
-    baseServer_ = std::make_unique<TcpServerSingle>(baseLoop_, local_);
+    if (spinBudget_ > Nanoseconds::zero()) {
+        baseLoop_->setBusyPoll(spinBudget_, socketBusyPollUs_);
+    }
+    if (hugePageBuffers_) {
+        baseLoop_->bufferPool()->setHugePages(true);
+    }
+    planPlacements();
+    if (!placements_.empty()) {
+        // 调用者的线程：baseLoop_已经构造，只影响之后的调度与新分配的页
+        applyThreadPlacement(placements_[0]);
+    }
     /**
-     * 如果想改主从Reactor结构，从这里入手，如果只有一个Reactor，则baseServer_回调即为外部传进来的回调，否则，baseServer_执行自己的回调（TcpServer中添加回调，
-     * 来实现连接分配算法），由子Reactor执行外部传进来的回调。Connection对象绑定loop的步骤也需要修改位于TcpServerSingle.cc : 32
+     * 默认每个loop的TcpServerSingle各自监听同一端口，由内核在SO_REUSEPORT组内分配连接；
+     * 设置了loadBalancer_时各TcpServerSingle都不监听，由acceptor_在baseLoop中accept后经dispatchConnection分派
     **/
+    {
+        std::lock_guard<std::mutex> guard(mutex_); // acceptStats可能同时在其他线程中读取
+        if (loadBalancer_) {
+            baseServer_ = std::make_unique<TcpServerSingle>(baseLoop_);
+        }
+        else baseServer_ = std::make_unique<TcpServerSingle>(baseLoop_, local_);
+        servers_.resize(numThreads_);
+        servers_[0] = baseServer_.get();
+    }
     baseServer_->setConnectionCallback(connectionCallback_);
     baseServer_->setMessageCallback(messageCallback_);
     baseServer_->setWriteCompleteCallback(writeCompleteCallback_);
+    baseServer_->setEdgeTriggered(edgeTriggered_);
+    baseServer_->setCorked(corked_);
+    baseServer_->setFlowControl(flowControl_);
+    baseServer_->setIdleTimeout(readIdleTimeout_, writeIdleTimeout_);
+    baseServer_->setIdleCallback(idleCallback_);
+    if (!loadBalancer_) {
+        baseServer_->setAcceptBatch(acceptBatch_);
+        if (!cpus_.empty()) {
+            baseServer_->setIncomingCpu(cpus_[0]);
+        }
+    }
     threadInitCallback_(0);
     baseServer_->start();
 
@@ -77,30 +220,126 @@ void TcpServer::startInLoop() {
         {
             std::unique_lock<std::mutex> lock(mutex_);
             while (eventLoops_[i] == nullptr) {
-                cond_.wait(lock); // 等待创建子EventLoop对象成功再继续
+                cond_.wait(lock); // 等待子EventLoop开始listen再继续，SO_REUSEPORT组内的顺序与loop的序号一致
             }
         }
         threads_.emplace_back(thread);
     }
+
+    if (loadBalancer_) {
+        // 所有子loop都已经登记到servers_之后才开始accept
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            acceptor_ = std::make_unique<Acceptor>(baseLoop_, local_);
+        }
+        acceptor_->setAcceptBatch(acceptBatch_);
+        acceptor_->setNewConnectionCallback(std::bind(&TcpServer::dispatchConnection, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+        acceptor_->listen();
+        return;
+    }
+
+    // 每个CPU上只有一个loop时才分流，否则同一CPU上的其他loop收不到连接
+    if (!cpus_.empty()) {
+        std::vector<int> sorted = cpus_;
+        std::sort(sorted.begin(), sorted.end());
+        if (std::unique(sorted.begin(), sorted.end()) == sorted.end()) {
+            if (baseServer_->attachCpuSteering(cpus_)) {
+                INFO("TcpServer {} steers connections to {} cpu(s)", local_.toIpPort(), cpus_.size());
+            }
+        }
+        else WARN("TcpServer {} has more loops than cpus, connections are not steered", local_.toIpPort());
+    }
+}
+
+void TcpServer::planPlacements() {
+    if (!threadPlacement_ && !cpuAffinity_) {
+        return;
+    }
+    std::vector<int> allowed;
+    if (!threadPlacement_) {
+        allowed = allowedCpus();
+        if (allowed.empty()) {
+            return;
+        }
+    }
+    for (size_t i = 0; i < numThreads_; ++i) {
+        ThreadPlacement placement;
+        if (threadPlacement_) {
+            placement = threadPlacement_(i);
+        }
+        else placement.cpus.push_back(allowed[i % allowed.size()]);
+        if (numaLocal_ && placement.numaNode < 0 && !placement.cpus.empty()) {
+            placement.numaNode = numaNodeOfCpu(placement.cpus[0]);
+        }
+        placements_.push_back(std::move(placement));
+    }
+    // 每个loop都只绑定一个CPU时，才能按CPU设置SO_INCOMING_CPU与分流
+    for (auto& placement : placements_) {
+        if (placement.cpus.size() != 1) {
+            cpus_.clear();
+            return;
+        }
+        cpus_.push_back(placement.cpus[0]);
+    }
 }
 
 void TcpServer::runInThread(size_t index) {
-    EventLoop loop;
-    TcpServerSingle server(&loop, local_); // 子EventLoop中的单独TcpServerSingle实例
+    // 在构造EventLoop之前绑定，loop、连接与缓冲的内存都在所在CPU与节点上首次访问
+    if (!placements_.empty()) {
+        applyThreadPlacement(placements_[index]);
+    }
+    EventLoop loop(pollerType_);
+    if (spinBudget_ > Nanoseconds::zero()) {
+        loop.setBusyPoll(spinBudget_, socketBusyPollUs_);
+    }
+    if (hugePageBuffers_) {
+        loop.bufferPool()->setHugePages(true);
+    }
+    // 子EventLoop中的单独TcpServerSingle实例，主从Reactor模式下不监听
+    auto server = loadBalancer_ ? std::make_unique<TcpServerSingle>(&loop)
+                                : std::make_unique<TcpServerSingle>(&loop, local_);
 
-    server.setConnectionCallback(connectionCallback_);
-    server.setMessageCallback(messageCallback_);
-    server.setWriteCompleteCallback(writeCompleteCallback_);
+    server->setConnectionCallback(connectionCallback_);
+    server->setMessageCallback(messageCallback_);
+    server->setWriteCompleteCallback(writeCompleteCallback_);
+    server->setEdgeTriggered(edgeTriggered_);
+    server->setCorked(corked_);
+    server->setFlowControl(flowControl_);
+    server->setIdleTimeout(readIdleTimeout_, writeIdleTimeout_);
+    server->setIdleCallback(idleCallback_);
+    if (!loadBalancer_) {
+        server->setAcceptBatch(acceptBatch_);
+        if (!cpus_.empty()) {
+            server->setIncomingCpu(cpus_[index]);
+        }
+    }
 
+    threadInitCallback_(index);
+    server->start();
     {
         std::lock_guard<std::mutex> guard(mutex_);
         eventLoops_[index] = &loop;
+        servers_[index] = server.get();
         cond_.notify_one();
     }
-
-    threadInitCallback_(index);
-    server.start();
     loop.loop();
     // 子EventLoop是栈上对象，若loop退出，意味着栈空间将回收，将指向子loop的指针置空
     eventLoops_[index] = nullptr;
-}
\ No newline at end of file
+    std::lock_guard<std::mutex> guard(mutex_);
+    servers_[index] = nullptr;
+}
+
+void TcpServer::dispatchConnection(int connfd, const InetAddress& local, const InetAddress& peer) {
+    baseLoop_->assertInLoopThread();
+    std::lock_guard<std::mutex> guard(mutex_);
+    loads_.clear();
+    for (auto server : servers_) {
+        // 子loop只在TcpServer析构时退出，此时不会再有新连接
+        assert(server != nullptr);
+        loads_.push_back(LoopLoad{server->connectionCount(), server->queuedBytes()});
+    }
+    size_t index = loadBalancer_(loads_) % loads_.size();
+    TRACE("TcpServer dispatch connection {} to loop {}", peer.toIpPort(), index);
+    servers_[index]->addConnection(connfd, local, peer);
+}
@@ -4,6 +4,9 @@
 #include <condition_variable>
 
 #include "TcpServerSingle.hpp"
+#include "LoadBalancer.hpp"
+#include "ThreadPlacement.hpp"
+#include "Poller.hpp"
 
 namespace mudong {
 
@@ -21,6 +24,54 @@ public:
 
     // n <= 1，则运行在baseLoop thread中；否则，将会启动另外n - 1个EventLoopThread
     void setNumThread(size_t n);
+    // 子EventLoop使用的IO多路复用后端，baseLoop由使用者自行构造
+    void setPollerType(Poller::Type type);
+    // 为所有EventLoop（包括baseLoop）开启混合忙轮询，参见EventLoop::setBusyPoll
+    void setBusyPoll(Nanoseconds spinBudget, int socketBusyPollUs = 0);
+    // 各EventLoop的BufferPool用大页映射arena，参见BufferPool::setHugePages
+    void setHugePageBuffers(bool on);
+    // 所有连接以EPOLLET边沿触发方式注册，参见TcpConnection::setEdgeTriggered
+    void setEdgeTriggered(bool on);
+    // 所有连接开启合并写，参见TcpConnection::setCorked
+    void setCorked(bool on);
+    // 所有连接的流控参数，参见TcpConnection::setFlowControl
+    void setFlowControl(const FlowControl& flowControl);
+    /**
+     * 连接超过readIdle没有读到数据、或超过writeIdle没有写出数据时调用IdleCallback（默认强制关闭连接），
+     * 为0表示不检查。每个EventLoop各自用一个IdleWheel管理自己的连接，刷新不需要加锁
+    **/
+    void setIdleTimeout(Nanoseconds readIdle, Nanoseconds writeIdle = Nanoseconds::zero());
+    // 回调在连接所属的EventLoop线程中执行
+    void setIdleCallback(const IdleCallback&);
+    // 每个EventLoop的Acceptor每次可读事件最多accept的连接数，参见Acceptor::setAcceptBatch
+    void setAcceptBatch(int batch);
+    /**
+     * 第i个EventLoop的线程绑定到进程允许的第i个CPU，并给SO_REUSEPORT组挂上按CPU分流的cBPF程序，
+     * 连接交给处理其数据包的CPU上的loop，协议栈与应用处理不跨核。线程数多于CPU数时只绑定线程、不分流。
+     * 0号是调用者自己的baseLoop线程：start时才绑定，此后一直有效，TcpServer析构也不会恢复；
+     * 其余线程在构造EventLoop之前绑定
+    **/
+    void setCpuAffinity(bool on);
+    /**
+     * 第i个EventLoop的线程应用callback(i)，可以给出任意CPU集合与NUMA节点，代替setCpuAffinity的逐个CPU绑定。
+     * 子线程在构造EventLoop和执行ThreadInitCallback之前应用，loop、连接与缓冲的内存都来自指定的节点。
+     * 0号是调用者自己的baseLoop线程，start时才应用：baseLoop_及其已经分配的内存不会迁移，
+     * 只有之后新分配的页遵循内存策略；绑定与内存策略一直有效，TcpServer析构也不会恢复
+    **/
+    void setThreadPlacement(const ThreadPlacementCallback& callback);
+    // 没有指定NUMA节点的loop线程，内存优先从其第一个CPU所在的节点分配，需要同时绑定CPU。对0号线程的限制同上
+    void setNumaLocal(bool on);
+    /**
+     * 切换为主从Reactor模式：只有baseLoop上的一个Acceptor监听，每个新连接由balancer在所有EventLoop
+     * （包括baseLoop）中选出一个，再交给它建立连接，不再依赖内核对SO_REUSEPORT组的哈希。
+     * 参见LoadBalancer.hpp中的内置策略，为空则恢复每个loop各自监听
+    **/
+    void setLoadBalancer(const LoadBalancer& balancer);
+
+    // 汇总所有EventLoop的accept统计，可以在任意线程中调用
+    Acceptor::Stats acceptStats();
+    // 按loop序号排列的当前连接数，0号为baseLoop，可以在任意线程中调用
+    std::vector<size_t> connectionCounts();
 
     void start();
 
@@ -32,17 +83,46 @@ public:
 private:
     void startInLoop();
     void runInThread(size_t index);
+    // 在start时确定各loop线程的放置方式
+    void planPlacements();
+    // 主从Reactor模式下baseLoop的Acceptor回调
+    void dispatchConnection(int connfd, const InetAddress& local, const InetAddress& peer);
 
     using ThreadPtr = std::unique_ptr<std::thread>;
     using ThreadPtrList = std::vector<ThreadPtr>;
     using TcpServerSinglePtr = std::unique_ptr<TcpServerSingle>;
     using EventLoopList = std::vector<EventLoop*>;
+    using ServerList = std::vector<TcpServerSingle*>;
 
     EventLoop* baseLoop_;
     TcpServerSinglePtr baseServer_;
     ThreadPtrList threads_;
     EventLoopList eventLoops_;
+    // 0号为baseServer_，其余为各子线程栈上的TcpServerSingle，线程退出前置空，由mutex_保护
+    ServerList servers_;
+    // 主从Reactor模式下的唯一监听者，位于baseLoop
+    std::unique_ptr<Acceptor> acceptor_;
+    LoadBalancer loadBalancer_;
+    // dispatchConnection复用的负载快照
+    std::vector<LoopLoad> loads_;
     size_t numThreads_;
+    Poller::Type pollerType_;
+    Nanoseconds spinBudget_;
+    int socketBusyPollUs_;
+    bool hugePageBuffers_;
+    bool edgeTriggered_;
+    bool corked_;
+    FlowControl flowControl_;
+    int acceptBatch_;
+    bool cpuAffinity_;
+    bool numaLocal_;
+    ThreadPlacementCallback threadPlacement_;
+    // 各EventLoop线程的放置方式，start时确定，为空表示不绑定
+    std::vector<ThreadPlacement> placements_;
+    // 每个EventLoop都只绑定一个CPU时为各自的CPU，否则为空
+    std::vector<int> cpus_;
+    Nanoseconds readIdleTimeout_;
+    Nanoseconds writeIdleTimeout_;
     std::atomic_bool started_;
     InetAddress local_;
     std::mutex mutex_;
@@ -51,6 +131,7 @@ private:
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
+    IdleCallback idleCallback_;
 };
 
 } // namespace ev
@@ -4,50 +4,196 @@
 #include "Buffer.hpp"
 #include "EventLoop.hpp"
 
+#include <unistd.h>
+
 using namespace mudong::ev;
 
 TcpServerSingle::TcpServerSingle(EventLoop* loop, const InetAddress& local)
-        : loop_(loop),
-          acceptor_(loop, local)
+        : TcpServerSingle(loop)
 {
-    acceptor_.setNewConnectionCallback(std::bind(&TcpServerSingle::newConnection, this, 
+    acceptor_ = std::make_unique<Acceptor>(loop, local);
+    acceptor_->setNewConnectionCallback(std::bind(&TcpServerSingle::addConnection, this, 
             std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 }
 
+TcpServerSingle::TcpServerSingle(EventLoop* loop)
+        : loop_(loop),
+          connectionCount_(0),
+          edgeTriggered_(false),
+          corked_(false),
+          readIdleTimeout_(Nanoseconds::zero()),
+          writeIdleTimeout_(Nanoseconds::zero()),
+          idleCallback_(defaultIdleCallback)
+{}
+
+TcpServerSingle::~TcpServerSingle() {
+    loop_->assertInLoopThread();
+    for (auto& conn : connections_) {
+        if (readIdleWheel_) {
+            readIdleWheel_->remove(conn.get());
+        }
+        if (writeIdleWheel_) {
+            writeIdleWheel_->remove(conn.get());
+        }
+        conn->connectDestroyed();
+        connectionCallback_(conn);
+        connectionCount_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    // loop退出前没有来得及建立的连接
+    handoffs_.drain([this](Handoff& handoff) {
+        ::close(handoff.connfd);
+        connectionCount_.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
+
 void TcpServerSingle::setConnectionCallback(const ConnectionCallback& callback) {
     connectionCallback_ = callback;
 }
 void TcpServerSingle::setMessageCallback(const MessageCallback& callback) {
     messageCallback_ = callback;
+    connectionCallbacks_.reset();
 }
 void TcpServerSingle::setWriteCompleteCallback(const WriteCompleteCallback& callback) {
     writeCompleteCallback_ = callback;
+    connectionCallbacks_.reset();
+}
+
+void TcpServerSingle::setEdgeTriggered(bool on) {
+    edgeTriggered_ = on;
+}
+
+void TcpServerSingle::setCorked(bool on) {
+    corked_ = on;
+}
+
+void TcpServerSingle::setFlowControl(const FlowControl& flowControl) {
+    flowControl_ = flowControl;
+    connectionCallbacks_.reset();
+}
+
+void TcpServerSingle::setIdleTimeout(Nanoseconds readIdle, Nanoseconds writeIdle) {
+    readIdleTimeout_ = readIdle;
+    writeIdleTimeout_ = writeIdle;
+}
+
+void TcpServerSingle::setIdleCallback(const IdleCallback& callback) {
+    idleCallback_ = callback;
+}
+
+void TcpServerSingle::setAcceptBatch(int batch) {
+    assert(acceptor_ != nullptr);
+    acceptor_->setAcceptBatch(batch);
+}
+
+void TcpServerSingle::setIncomingCpu(int cpu) {
+    assert(acceptor_ != nullptr);
+    acceptor_->setIncomingCpu(cpu);
+}
+
+bool TcpServerSingle::attachCpuSteering(const std::vector<int>& cpus) {
+    assert(acceptor_ != nullptr);
+    return acceptor_->attachCpuSteering(cpus);
+}
+
+Acceptor::Stats TcpServerSingle::acceptStats() const {
+    if (acceptor_ == nullptr) {
+        return Acceptor::Stats{0, 0, 0};
+    }
+    return acceptor_->stats();
+}
+
+size_t TcpServerSingle::connectionCount() const {
+    return connectionCount_.load(std::memory_order_relaxed);
+}
+
+size_t TcpServerSingle::queuedBytes() const {
+    return loop_->queuedOutputBytes();
 }
 
 void TcpServerSingle::start() {
-    acceptor_.listen();
+    if (readIdleTimeout_ > Nanoseconds::zero()) {
+        readIdleWheel_ = std::make_unique<IdleWheel>(loop_, IdleKind::kRead, readIdleTimeout_, idleCallback_);
+    }
+    if (writeIdleTimeout_ > Nanoseconds::zero()) {
+        writeIdleWheel_ = std::make_unique<IdleWheel>(loop_, IdleKind::kWrite, writeIdleTimeout_, idleCallback_);
+    }
+    if (acceptor_ != nullptr) {
+        acceptor_->listen();
+    }
+}
+
+// 这里的逻辑将会传递给acceptor_->setNewConnectionCallback，当acceptfd_有可读事件触发，即有新连接请求到来时，就执行该逻辑。
+// 主从Reactor模式下由baseLoop线程调用，先计数，负载均衡策略立即能看到这个还没有建立的连接
+void TcpServerSingle::addConnection(int connfd, const InetAddress& local, const InetAddress& peer) {
+    connectionCount_.fetch_add(1, std::memory_order_relaxed);
+    if (loop_->isInLoopThread()) {
+        newConnection(connfd, local, peer);
+        return;
+    }
+    // 排队的任务在loop退出后不会再执行，connfd留在handoffs_中由析构函数关闭
+    handoffs_.push(Handoff{connfd, local, peer});
+    loop_->queueInLoop([this]() { takeHandoffs(); });
+}
+
+void TcpServerSingle::takeHandoffs() {
+    handoffs_.drain([this](Handoff& handoff) {
+        newConnection(handoff.connfd, handoff.local, handoff.peer);
+    });
 }
 
-// 这里的逻辑将会传递给acceptor_.setNewConnectionCallback，当acceptfd_有可读事件触发，即有新连接请求到来时，就执行该逻辑
 void TcpServerSingle::newConnection(int connfd, const InetAddress& local, const InetAddress& peer) {
     loop_->assertInLoopThread();
+    int busyPollUs = loop_->socketBusyPollUs();
+    if (busyPollUs > 0) {
+        // 让该socket上的阻塞读与poll在设备队列上忙等，权限已在EventLoop::setBusyPoll中检查过，
+        // 这里失败只影响延迟，不逐个连接记录
+        static_cast<void>(setsockopt(connfd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUs, sizeof(busyPollUs)));
+    }
     auto conn = std::make_shared<TcpConnection>(loop_, connfd, local, peer);
     connections_.insert(conn);
-    conn->setMessageCallback(messageCallback_);
-    conn->setWriteCompleteCallback(writeCompleteCallback_);
-    conn->setCloseCallback(std::bind(&TcpServerSingle::closeConnection, this, std::placeholders::_1));
-    
-    // 将connfd的channel tie上TcpConnection对象
+    conn->setCallbacks(connectionCallbacks());
+    if (edgeTriggered_) {
+        conn->setEdgeTriggered(true);
+    }
+    if (corked_) {
+        conn->setCorked(true);
+    }
+
     conn->connectEstablished();
+    if (readIdleWheel_) {
+        readIdleWheel_->add(conn.get());
+    }
+    if (writeIdleWheel_) {
+        writeIdleWheel_->add(conn.get());
+    }
 
     connectionCallback_(conn);
 }
 
+const TcpConnectionCallbacksPtr& TcpServerSingle::connectionCallbacks() {
+    if (connectionCallbacks_ == nullptr) {
+        auto callbacks = std::make_shared<TcpConnectionCallbacks>();
+        callbacks->message = messageCallback_;
+        callbacks->writeComplete = writeCompleteCallback_;
+        callbacks->flowControl = flowControl_;
+        callbacks->close = std::bind(&TcpServerSingle::closeConnection, this, std::placeholders::_1);
+        connectionCallbacks_ = std::move(callbacks);
+    }
+    return connectionCallbacks_;
+}
+
 void TcpServerSingle::closeConnection(const TcpConnectionPtr& conn) {
     loop_->assertInLoopThread();
     size_t ret = connections_.erase(conn);
     if (ret != 1) {
         FATAL("TcpServerSingle::closeConnection connection set erase fatal, ret = {}", ret);
     }
+    connectionCount_.fetch_sub(1, std::memory_order_relaxed);
+    if (readIdleWheel_) {
+        readIdleWheel_->remove(conn.get());
+    }
+    if (writeIdleWheel_) {
+        writeIdleWheel_->remove(conn.get());
+    }
     connectionCallback_(conn);
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <unordered_set>
 
 #include "Callbacks.hpp"
 #include "Acceptor.hpp"
+#include "IdleWheel.hpp"
+#include "MpscQueue.hpp"
+#include "TcpConnection.hpp"
 
 namespace mudong {
 
@@ -15,26 +19,73 @@ class TcpServerSingle : noncopyable {
 
 public:
     TcpServerSingle(EventLoop* loop, const InetAddress& local);
+    // 不监听端口，连接由其他loop accept之后通过addConnection交给它，用于主从Reactor模式的子loop
+    explicit TcpServerSingle(EventLoop* loop);
+    // 在loop线程中析构，断开还存在的连接并以断开状态调用ConnectionCallback
+    ~TcpServerSingle();
 
     void setConnectionCallback(const ConnectionCallback& callback);
     void setMessageCallback(const MessageCallback &callback);
     void setWriteCompleteCallback(const WriteCompleteCallback &callback);
+    void setEdgeTriggered(bool on);
+    void setCorked(bool on);
+    void setFlowControl(const FlowControl& flowControl);
+    // 在start之前调用，超时时长为0表示不检查该种空闲
+    void setIdleTimeout(Nanoseconds readIdle, Nanoseconds writeIdle);
+    void setIdleCallback(const IdleCallback& callback);
+    void setAcceptBatch(int batch);
+    // 参见Acceptor::setIncomingCpu与Acceptor::attachCpuSteering
+    void setIncomingCpu(int cpu);
+    bool attachCpuSteering(const std::vector<int>& cpus);
     
     void start();
 
+    // 以下可以在任意线程中调用
+    // 接管已经accept的connfd，在所属loop中建立连接
+    void addConnection(int connfd, const InetAddress& local, const InetAddress& peer);
+    // 没有Acceptor时统计全为0
+    Acceptor::Stats acceptStats() const;
+    // 已经接受或交给它、还没有关闭的连接数
+    size_t connectionCount() const;
+    // 所属loop上所有连接还没有写出的字节数
+    size_t queuedBytes() const;
+
 private:
     using ConnectionSet = std::unordered_set<TcpConnectionPtr>;
 
+    // 其他线程交给本loop、还没有建立的连接
+    struct Handoff {
+        int connfd;
+        InetAddress local;
+        InetAddress peer;
+    };
+
+    // 在loop线程中建立handoffs_中的连接
+    void takeHandoffs();
+
     void newConnection(int connfd, const InetAddress &local, const InetAddress &peer);
 
     void closeConnection(const TcpConnectionPtr &conn);
+    // 所有连接共享的回调表，第一次建立连接时生成，修改回调后重新生成
+    const TcpConnectionCallbacksPtr& connectionCallbacks();
 
     EventLoop* loop_;
-    Acceptor acceptor_;
+    std::unique_ptr<Acceptor> acceptor_;
     ConnectionSet connections_;
+    std::atomic_size_t connectionCount_;
+    MpscQueue<Handoff> handoffs_;
+    bool edgeTriggered_;
+    bool corked_;
+    Nanoseconds readIdleTimeout_;
+    Nanoseconds writeIdleTimeout_;
+    std::unique_ptr<IdleWheel> readIdleWheel_;
+    std::unique_ptr<IdleWheel> writeIdleWheel_;
+    IdleCallback idleCallback_;
     ConnectionCallback connectionCallback_;
     MessageCallback messageCallback_;
     WriteCompleteCallback writeCompleteCallback_;
+    FlowControl flowControl_;
+    TcpConnectionCallbacksPtr connectionCallbacks_;
 };
 
 } // namespace ev
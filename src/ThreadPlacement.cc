@@ -0,0 +1,98 @@
+#include "ThreadPlacement.hpp"
+#include "Logger.hpp"
+
+#include <cassert>
+#include <dirent.h>
+#include <sched.h>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace mudong {
+
+namespace ev {
+
+namespace {
+
+// 与<numaif.h>中的定义一致
+const int kMpolPreferred = 1;
+
+} // anonymous namespace
+
+std::vector<int> allowedCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        SYSERR("allowedCpus sched_getaffinity");
+        return cpus;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+int numaNodeOfCpu(int cpu) {
+    // 每个CPU目录下有一个指向所在节点的nodeN链接
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = ::opendir(path.c_str());
+    if (dir == nullptr) {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent* entry = ::readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+            name.find_first_not_of("0123456789", 4) == std::string::npos) {
+            node = std::stoi(name.substr(4));
+            break;
+        }
+    }
+    ::closedir(dir);
+    return node;
+}
+
+bool setThreadAffinity(const std::vector<int>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        assert(cpu >= 0 && cpu < CPU_SETSIZE);
+        CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+        SYSERR("setThreadAffinity sched_setaffinity {} cpu(s)", cpus.size());
+        return false;
+    }
+    return true;
+}
+
+bool setMemoryNode(int node) {
+    const unsigned long kBits = 8 * sizeof(unsigned long);
+    assert(node >= 0);
+    std::vector<unsigned long> mask(static_cast<size_t>(node) / kBits + 1, 0);
+    mask[static_cast<size_t>(node) / kBits] = 1UL << (static_cast<unsigned long>(node) % kBits);
+    // maxnode是掩码的位数，内核会忽略最后一位，所以多给一位
+    if (::syscall(SYS_set_mempolicy, kMpolPreferred, mask.data(), mask.size() * kBits + 1) == -1) {
+        SYSERR("setMemoryNode set_mempolicy node {}", node);
+        return false;
+    }
+    return true;
+}
+
+bool applyThreadPlacement(const ThreadPlacement& placement) {
+    bool ok = true;
+    if (!placement.cpus.empty()) {
+        ok = setThreadAffinity(placement.cpus) && ok;
+    }
+    if (placement.numaNode >= 0) {
+        ok = setMemoryNode(placement.numaNode) && ok;
+    }
+    return ok;
+}
+
+} // namespace ev
+
+} // namespace mudong
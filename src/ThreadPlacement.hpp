@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace mudong {
+
+namespace ev {
+
+// 一个线程允许运行的CPU与内存分配优先使用的NUMA节点
+struct ThreadPlacement {
+    // 为空表示不限制
+    std::vector<int> cpus;
+    // 小于0表示不设置内存策略
+    int numaNode = -1;
+};
+
+// 按线程序号给出放置方式，在该线程执行ThreadInitCallback之前应用，参见TcpServer::setThreadPlacement
+using ThreadPlacementCallback = std::function<ThreadPlacement(size_t index)>;
+
+// 进程允许运行的CPU，按编号排列
+std::vector<int> allowedCpus();
+// cpu所在的NUMA节点，读取sysfs，没有NUMA信息时返回-1
+int numaNodeOfCpu(int cpu);
+
+// 以下只作用于调用线程，失败时记录日志并返回false
+bool setThreadAffinity(const std::vector<int>& cpus);
+/**
+ * 之后新分配的页优先来自node（MPOL_PREFERRED），该节点内存不足时退回其他节点而不是OOM。
+ * 直接使用set_mempolicy系统调用，不依赖libnuma
+**/
+bool setMemoryNode(int node);
+bool applyThreadPlacement(const ThreadPlacement& placement);
+
+} // namespace ev
+
+} // namespace mudong
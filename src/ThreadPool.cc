@@ -3,10 +3,14 @@
 
 using namespace mudong::ev;
 
-ThreadPool::ThreadPool(size_t threadNum, size_t maxQueueSize, const ThreadInitCallback& callback)
-        : maxQueueSize_(maxQueueSize),
+ThreadPool::ThreadPool(size_t threadNum, size_t maxQueueSize, const ThreadInitCallback& callback,
+                       const ThreadPlacementCallback& placement)
+        : queueHead_(0),
+          queueSize_(0),
+          maxQueueSize_(maxQueueSize),
           running_(true),
-          threadInitCallback_(callback)
+          threadInitCallback_(callback),
+          threadPlacement_(placement)
 {
     assert(maxQueueSize_ > 0);
     for (size_t i = 0; i < threadNum; ++i) { // 从0开始标号，作为线程池中线程的标识
@@ -22,32 +26,27 @@ ThreadPool::~ThreadPool() {
     TRACE("ThreadPool destruct");
 }
 
-void ThreadPool::runTask(const Task& task) {
+void ThreadPool::runTask(Task task) {
     assert(running_);
     if (threads_.empty()) {
         task();
     }
     else {
         std::unique_lock<std::mutex> lock(mutex_);
-        while (taskQueue_.size() >= maxQueueSize_) {
+        while (queueSize_ >= maxQueueSize_) {
             notFull_.wait(lock);
         }
-        taskQueue_.push(task);
-        notEmpty_.notify_one();
-    }
-}
-
-void ThreadPool::runTask(Task&& task) {
-    assert(running_);
-    if (threads_.empty()) {
-        task();
-    }
-    else {
-        std::unique_lock<std::mutex> lock(mutex_);
-        while (taskQueue_.size() >= maxQueueSize_) {
-            notFull_.wait(lock);
+        if (queueSize_ == taskQueue_.size()) {
+            // 扩容时按出队顺序搬到新缓冲区的开头
+            std::vector<Task> tasks(std::max<size_t>(16, taskQueue_.size() * 2));
+            for (size_t i = 0; i < queueSize_; ++i) {
+                tasks[i] = std::move(taskQueue_[(queueHead_ + i) % taskQueue_.size()]);
+            }
+            taskQueue_.swap(tasks);
+            queueHead_ = 0;
         }
-        taskQueue_.push(std::move(task));
+        taskQueue_[(queueHead_ + queueSize_) % taskQueue_.size()] = std::move(task);
+        ++queueSize_;
         notEmpty_.notify_one();
     }
 }
@@ -69,6 +68,9 @@ size_t ThreadPool::threadNum() const {
 }
 
 void ThreadPool::runInThread(size_t index) {
+    if (threadPlacement_) {
+        applyThreadPlacement(threadPlacement_(index));
+    }
     if (threadInitCallback_) {
         threadInitCallback_(index);
     }
@@ -82,13 +84,14 @@ void ThreadPool::runInThread(size_t index) {
 Task ThreadPool::take() {
     std::unique_lock<std::mutex> lock(mutex_);
     // 确保能在停止指令发出时，正确停止，返回一个空Task
-    while (taskQueue_.empty() && running_) {
+    while (queueSize_ == 0 && running_) {
         notEmpty_.wait(lock);
     }
     Task task;
-    if (!taskQueue_.empty()) {
-        task = taskQueue_.front();
-        taskQueue_.pop();
+    if (queueSize_ > 0) {
+        task = std::move(taskQueue_[queueHead_]);
+        queueHead_ = (queueHead_ + 1) % taskQueue_.size();
+        --queueSize_;
         notFull_.notify_one();
     }
     return task;
@@ -2,10 +2,11 @@
 
 #include <thread>
 #include <condition_variable>
-#include <queue>
+#include <vector>
 
 #include "noncopyable.hpp"
 #include "Callbacks.hpp"
+#include "ThreadPlacement.hpp"
 
 namespace mudong {
 
@@ -14,11 +15,12 @@ namespace ev {
 class ThreadPool: noncopyable {
 
 public:
-    explicit ThreadPool(size_t threadNum, size_t maxQueueSize = 65536, const ThreadInitCallback& callback = nullptr);
+    // placement(i)在第i个工作线程执行callback之前应用，参见TcpServer::setThreadPlacement
+    explicit ThreadPool(size_t threadNum, size_t maxQueueSize = 65536, const ThreadInitCallback& callback = nullptr,
+                        const ThreadPlacementCallback& placement = nullptr);
     ~ThreadPool();
 
-    void runTask(const Task&);
-    void runTask(Task&&);
+    void runTask(Task task);
     void stop();
     size_t threadNum() const;
 
@@ -33,10 +35,14 @@ private:
     std::mutex mutex_;
     std::condition_variable notEmpty_;
     std::condition_variable notFull_;
-    std::queue<Task> taskQueue_;
+    // 环形缓冲区，只在队列增长时扩容，稳态下入队出队不分配内存
+    std::vector<Task> taskQueue_;
+    size_t queueHead_;
+    size_t queueSize_;
     const size_t maxQueueSize_;
     std::atomic_bool running_;
     ThreadInitCallback threadInitCallback_;
+    ThreadPlacementCallback threadPlacement_;
 };
 
 } // namespace ev
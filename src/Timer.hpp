@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 
 #include "noncopyable.hpp"
 #include "Callbacks.hpp"
@@ -18,7 +19,11 @@ public:
               when_(when),
               interval_(interval),
               repeat_(interval_ > Nanoseconds::zero()),
-              canceled_(false)
+              canceled_(false),
+              prev_(nullptr),
+              next_(nullptr),
+              bucket_(nullptr),
+              slot_(0)
     {}
 
     void run() {
@@ -53,11 +58,20 @@ public:
 
 
 private:
+    friend class TimingWheel;
+    friend class TimerQueue;
+
     TimerCallback callback_;
     Timestamp when_;
     const Nanoseconds interval_;
     bool repeat_;
     bool canceled_;
+    // 时间轮中的侵入式双向链表节点，bucket_为nullptr表示不在时间轮中
+    Timer* prev_;
+    Timer* next_;
+    void* bucket_;
+    // 在TimerQueue槽位池中的下标
+    uint32_t slot_;
 };
 
 } // namespace ev
@@ -0,0 +1,57 @@
+#include "TimerEngine.hpp"
+#include "TimingWheel.hpp"
+#include "Timer.hpp"
+
+using namespace mudong::ev;
+
+std::unique_ptr<TimerEngine> TimerEngine::newEngine(Type type) {
+    if (type == Type::kTimingWheel) {
+        return std::make_unique<TimingWheel>();
+    }
+    return std::make_unique<OrderedSetTimerEngine>();
+}
+
+const char* TimerEngine::typeName(Type type) {
+    switch (type) {
+        case Type::kTimingWheel:
+            return "timing wheel";
+        default:
+            return "ordered set";
+    }
+}
+
+void OrderedSetTimerEngine::insert(Timer* timer) {
+    auto checkPair = timers_.insert({timer->when(), timer});
+    assert(checkPair.second);
+    (void)checkPair;
+}
+
+void OrderedSetTimerEngine::erase(Timer* timer) {
+    timers_.erase({timer->when(), timer});
+}
+
+bool OrderedSetTimerEngine::empty() const {
+    return timers_.empty();
+}
+
+Timestamp OrderedSetTimerEngine::nextExpiration() const {
+    assert(!timers_.empty());
+    return timers_.begin()->first;
+}
+
+void OrderedSetTimerEngine::takeExpired(Timestamp now, std::vector<Timer*>& expired) {
+    using namespace std::chrono;
+    Entry endEntry(now + 1ns, nullptr);
+    auto end = timers_.lower_bound(endEntry);
+    for (auto it = timers_.begin(); it != end; ++it) {
+        expired.push_back(it->second);
+    }
+    timers_.erase(timers_.begin(), end);
+}
+
+void OrderedSetTimerEngine::takeAll(std::vector<Timer*>& timers) {
+    for (auto& e : timers_) {
+        timers.push_back(e.second);
+    }
+    timers_.clear();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "noncopyable.hpp"
+#include "Timestamp.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+class Timer;
+
+// TimerQueue中保存定时器的数据结构，只在loop线程中使用
+class TimerEngine: noncopyable {
+
+public:
+    enum class Type {
+        kOrderedSet,
+        kTimingWheel
+    };
+
+    virtual ~TimerEngine() = default;
+
+    virtual void insert(Timer* timer) = 0;
+    // timer不在引擎中时什么也不做
+    virtual void erase(Timer* timer) = 0;
+    virtual bool empty() const = 0;
+    // 下一次需要检查到期定时器的时刻，最多比最早的到期时刻晚一个精度单位，引擎为空时无意义
+    virtual Timestamp nextExpiration() const = 0;
+    // 将所有到期（when <= now）的定时器移出引擎并追加到expired中
+    virtual void takeExpired(Timestamp now, std::vector<Timer*>& expired) = 0;
+    // 移出全部定时器，用于析构或切换引擎
+    virtual void takeAll(std::vector<Timer*>& timers) = 0;
+
+    static std::unique_ptr<TimerEngine> newEngine(Type type);
+    static const char* typeName(Type type);
+};
+
+// 按(到期时刻, Timer*)排序的红黑树，插入与删除O(log n)
+class OrderedSetTimerEngine: public TimerEngine {
+
+public:
+    void insert(Timer* timer) override;
+    void erase(Timer* timer) override;
+    bool empty() const override;
+    Timestamp nextExpiration() const override;
+    void takeExpired(Timestamp now, std::vector<Timer*>& expired) override;
+    void takeAll(std::vector<Timer*>& timers) override;
+
+private:
+    using Entry = std::pair<Timestamp, Timer*>;
+    using TimerList = std::set<Entry>;
+
+    TimerList timers_;
+};
+
+} // namespace ev
+
+} // namespace mudong
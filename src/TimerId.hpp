@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+namespace mudong {
+
+namespace ev {
+
+/**
+ * 定时器句柄：TimerQueue中定时器槽位的下标加上该槽位的代数。
+ * 定时器触发完毕或被取消后槽位的代数会加一，因此过期的句柄不会误操作复用该槽位的新定时器，
+ * 对它调用cancelTimer是安全的空操作。默认构造的句柄无效。
+**/
+class TimerId {
+
+public:
+    TimerId()
+            : index_(kInvalidIndex),
+              generation_(0)
+    {}
+
+    bool valid() const {
+        return index_ != kInvalidIndex;
+    }
+
+private:
+    friend class TimerQueue;
+
+    static const uint32_t kInvalidIndex = UINT32_MAX;
+
+    TimerId(uint32_t index, uint32_t generation)
+            : index_(index),
+              generation_(generation)
+    {}
+
+    uint32_t index_;
+    uint32_t generation_;
+};
+
+} // namespace ev
+
+} // namespace mudong
@@ -25,13 +25,12 @@ void timerfdRead(int fd) {
     }
 }
 
-// 返回从当前时间点到指定时间戳之间的时间间隔
-timespec durationFromNow(Timestamp when) {
+// 返回从当前时间点到指定时间戳之间的时间间隔，不短于minDelay（为0会关闭timerfd）
+timespec durationFromNow(Timestamp when, Nanoseconds minDelay) {
     timespec ret;
     Nanoseconds ns = when - clock::now();
 
-    using namespace std::chrono;
-    if (ns < 1ms) ns = 1ms;
+    if (ns < minDelay) ns = minDelay;
 
     // 分别设置秒数和纳秒数
     ret.tv_sec = static_cast<time_t>(ns.count() / std::nano::den);
@@ -51,11 +50,14 @@ struct itimerspec {
 };
 */
 
-void timerfdSet(int fd, Timestamp when) {
+// when为Timestamp::max()时关闭timerfd
+void timerfdSet(int fd, Timestamp when, Nanoseconds minDelay) {
     itimerspec oldtime, newtime;
     memset(&oldtime, 0, sizeof(itimerspec));
     memset(&newtime, 0, sizeof(itimerspec));
-    newtime.it_value = durationFromNow(when);
+    if (when != Timestamp::max()) {
+        newtime.it_value = durationFromNow(when, minDelay);
+    }
 
     int ret = timerfd_settime(fd, 0, &newtime, &oldtime);
     if (ret == -1) {
@@ -65,81 +67,205 @@ void timerfdSet(int fd, Timestamp when) {
 
 } // anonymous namespace
 
-TimerQueue::TimerQueue(EventLoop* loop)
+const Channel::Handlers TimerQueue::kChannelHandlers = {
+    [](void* owner) { static_cast<TimerQueue*>(owner)->handleRead(); },
+    nullptr,
+    nullptr,
+    nullptr,
+    nullptr
+};
+
+TimerQueue::TimerQueue(EventLoop* loop, TimerEngine::Type engineType)
         : loop_(loop),
           timerfd_(timerfdCreate()),
-          timerChannel_(loop, timerfd_)
+          timerChannel_(loop, timerfd_),
+          engineType_(engineType),
+          mode_(Mode::kTimerfd),
+          precise_(false),
+          engine_(TimerEngine::newEngine(engineType)),
+          nextExpiration_(Timestamp::max()),
+          slotCount_(0),
+          freeHead_(TimerId::kInvalidIndex)
 {
     loop_->assertInLoopThread();
-    timerChannel_.setReadCallback([this](){this->handleRead();}); // 定时器触发时，timerFd_会有可读事件，交由handleRead来处理
+    timerChannel_.setHandlers(&kChannelHandlers, this); // 定时器触发时，timerFd_会有可读事件，交由handleRead来处理
     timerChannel_.enableRead();
 }
 
 TimerQueue::~TimerQueue() {
-    for (auto& p : timers_) {
-        delete p.second;
-    }
+    std::vector<Timer*> timers;
+    engine_->takeAll(timers); // 槽位池中的Timer随chunks_一起析构
     close(timerfd_);
 }
 
-Timer* TimerQueue::addTimer(TimerCallback callback, Timestamp when, Nanoseconds interval) {
-    Timer* timer = new Timer(std::move(callback), when, interval);
-    loop_->runInLoop(
-        [this, when, timer]() {
-            auto checkPair = timers_.insert({when, timer});
-            assert(checkPair.second);
-            // 新插入的就是时间最邻近的，那么就设置定时器触发时刻为最近的时间点
-            if (timers_.begin() == checkPair.first) {
-                timerfdSet(timerfd_, when);
-            }
-        }
-    );
-    return timer;
+TimerId TimerQueue::addTimer(TimerCallback callback, Timestamp when, Nanoseconds interval) {
+    TimerId id = allocateSlot();
+    Timer& timer = slotAt(id.index_).timer.emplace(std::move(callback), when, interval);
+    timer.slot_ = id.index_;
+    loop_->runInLoop([this, id]() { insert(id); });
+    return id;
 }
 
-void TimerQueue::cancelTimer(Timer* timer) {
-    loop_->runInLoop(
-        [this, timer]() {
-            timer->cancel();
-            timers_.erase({timer->when(), timer});
-            delete timer;
-        }
-    );
+void TimerQueue::cancelTimer(TimerId id) {
+    if (!id.valid()) {
+        return;
+    }
+    loop_->runInLoop([this, id]() { cancel(id); });
+}
+
+void TimerQueue::insert(TimerId id) {
+    loop_->assertInLoopThread();
+    Slot& slot = slotAt(id.index_);
+    Timer* timer = &*slot.timer;
+    if (timer->canceled()) { // 在插入之前就已经被其它线程取消
+        releaseSlot(id.index_);
+        return;
+    }
+    engine_->insert(timer);
+    slot.inEngine = true;
+    // 新插入的定时器比timerfd_当前设定的时刻更早，那么就设置定时器触发时刻为最近的时间点
+    if (timer->when() < nextExpiration_) {
+        resetTimerfd();
+    }
+}
+
+void TimerQueue::cancel(TimerId id) {
+    loop_->assertInLoopThread();
+    Slot& slot = slotAt(id.index_);
+    // 代数不同说明定时器已经触发完毕或被取消，槽位可能已被复用
+    if (slot.generation != id.generation_ || slot.timer->canceled()) {
+        return;
+    }
+    Timer* timer = &*slot.timer;
+    timer->cancel();
+    if (slot.inEngine) {
+        engine_->erase(timer);
+        slot.inEngine = false;
+        releaseSlot(id.index_);
+    }
+    // 否则定时器正在runExpired中等待执行，或者插入任务尚未执行，由它们负责回收槽位
 }
 
 void TimerQueue::handleRead() {
     loop_->assertInLoopThread();
     timerfdRead(timerfd_); // 将可读的内容读取一下从而清空缓冲区
+    runExpired();
+    nextExpiration_ = Timestamp::max();
+    resetTimerfd(); // 如果还有未到时间的定时器，那就把最近的时间点作为触发时间点（向内核中注册的定时器其实只有一个，定时器队列由网络库维护）
+}
 
-    Timestamp now(clock::now());
-    for (auto& e : getExpired(now)) {
-        Timer* timer = e.second;
+void TimerQueue::runExpired() {
+    loop_->assertInLoopThread();
+    if (engine_->empty()) {
+        return;
+    }
+    Timestamp now(loop_->now()); // 本轮poll返回时缓存的时间，不再单独读取时钟
+    if (now < engine_->nextExpiration()) {
+        return;
+    }
+    // 将已过期的定时器从引擎中移除，expired_复用以避免每次分配
+    expired_.clear();
+    engine_->takeExpired(now, expired_);
+    for (Timer* timer : expired_) {
+        slotAt(timer->slot_).inEngine = false;
+    }
+    for (Timer* timer : expired_) {
         assert(timer->expired(now)); // now >= when
 
         if (!timer->canceled()) {
             timer->run();
         }
         if (!timer->canceled() && timer->repeat()) {
-            timer->restart();
-            e.first = timer->when(); // 如果需要重复，那就按interval设置新的时间戳，并加入定时器管理集合
-            timers_.insert(e);
+            timer->restart(); // 如果需要重复，那就按interval设置新的时间戳，并加入定时器管理集合
+            engine_->insert(timer);
+            slotAt(timer->slot_).inEngine = true;
+        }
+        else releaseSlot(timer->slot_); //否则说明已经被取消了，回收槽位
+    }
+}
+
+TimerId TimerQueue::allocateSlot() {
+    std::lock_guard<std::mutex> guard(slotMutex_);
+    if (freeHead_ == TimerId::kInvalidIndex) {
+        uint32_t chunk = slotCount_ >> kChunkBits;
+        if (chunk >= kMaxChunks) {
+            FATAL("TimerQueue::allocateSlot too many timers ({})", slotCount_);
         }
-        else delete timer; //否则说明已经被取消了，直接丢弃
+        chunks_[chunk].reset(new Slot[kChunkSize]);
+        // 新块中的槽位按下标顺序串入空闲链表
+        for (uint32_t i = 0; i < kChunkSize; ++i) {
+            chunks_[chunk][i].nextFree = i + 1 < kChunkSize ? slotCount_ + i + 1 : TimerId::kInvalidIndex;
+        }
+        freeHead_ = slotCount_;
+        slotCount_ += kChunkSize;
     }
+    uint32_t index = freeHead_;
+    Slot& slot = slotAt(index);
+    freeHead_ = slot.nextFree;
+    return TimerId(index, slot.generation);
+}
+
+void TimerQueue::releaseSlot(uint32_t index) {
+    Slot& slot = slotAt(index);
+    assert(!slot.inEngine);
+    slot.timer.reset();
+    std::lock_guard<std::mutex> guard(slotMutex_);
+    ++slot.generation;
+    slot.nextFree = freeHead_;
+    freeHead_ = index;
+}
+
+TimerQueue::Slot& TimerQueue::slotAt(uint32_t index) {
+    return chunks_[index >> kChunkBits][index & (kChunkSize - 1)];
+}
 
-    if (!timers_.empty()) {
-        timerfdSet(timerfd_, timers_.begin()->first); // 如果还有未到时间的定时器，那就把最近的时间点作为触发时间点（向内核中注册的定时器其实只有一个，定时器队列由网络库维护）
+void TimerQueue::resetTimerfd() {
+    if (mode_ != Mode::kTimerfd || engine_->empty()) {
+        return;
+    }
+    Timestamp next = engine_->nextExpiration();
+    if (next != nextExpiration_) {
+        nextExpiration_ = next;
+        timerfdSet(timerfd_, next, precise_ ? Microseconds(1) : Milliseconds(1));
     }
 }
 
-// 将已过期的定时器从set中移除，并返回已过期的Entry数组
-std::vector<TimerQueue::Entry> TimerQueue::getExpired(Timestamp now) {
-    using namespace std::chrono;
-    Entry endEntry(now + 1ns, nullptr);
-    std::vector<Entry> ret;
+void TimerQueue::setEngine(TimerEngine::Type engineType) {
+    loop_->assertInLoopThread();
+    if (engineType == engineType_) {
+        return;
+    }
+    std::vector<Timer*> timers;
+    engine_->takeAll(timers);
+    engine_ = TimerEngine::newEngine(engineType);
+    engineType_ = engineType;
+    for (Timer* timer : timers) {
+        engine_->insert(timer);
+    }
+    nextExpiration_ = Timestamp::max();
+    resetTimerfd();
+}
 
-    auto end = timers_.lower_bound(endEntry);
-    ret.assign(timers_.begin(), end);
-    timers_.erase(timers_.begin(), end);
-    return ret;
-}
\ No newline at end of file
+TimerEngine::Type TimerQueue::engineType() const {
+    return engineType_;
+}
+void TimerQueue::setMode(Mode mode, bool precise) {
+    loop_->assertInLoopThread();
+    mode_ = mode;
+    precise_ = precise;
+    // kPollTimeout模式下关闭timerfd_，nextExpiration_保持为Timestamp::max()
+    nextExpiration_ = Timestamp::max();
+    timerfdSet(timerfd_, Timestamp::max(), Nanoseconds::zero());
+    resetTimerfd();
+}
+
+TimerQueue::Mode TimerQueue::mode() const {
+    return mode_;
+}
+
+Nanoseconds TimerQueue::pollTimeout() const {
+    if (mode_ != Mode::kPollTimeout || engine_->empty()) {
+        return Poller::kPollForever;
+    }
+    return std::max(engine_->nextExpiration() - clock::now(), Nanoseconds::zero());
+}
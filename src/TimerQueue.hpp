@@ -1,10 +1,15 @@
 #pragma once
 
+#include <array>
 #include <memory>
-#include <set>
+#include <mutex>
+#include <optional>
 
 #include "Timer.hpp"
+#include "TimerId.hpp"
+#include "TimerEngine.hpp"
 #include "Channel.hpp"
+#include "Poller.hpp"
 #include "Timestamp.hpp"
 #include "noncopyable.hpp"
 
@@ -15,26 +20,86 @@ namespace ev {
 class TimerQueue: noncopyable {
 
 public:
-    explicit TimerQueue(EventLoop* loop);
+    /**
+     * kTimerfd：由timerfd_通知到期，每次最早到期时刻变化都需要timerfd_settime，每次触发多一次可读事件与read；
+     * kPollTimeout：EventLoop把最近的到期时刻作为poll的超时，poll返回后直接执行到期的定时器，省去上述系统调用
+    **/
+    enum class Mode {
+        kTimerfd,
+        kPollTimeout
+    };
+
+    explicit TimerQueue(EventLoop* loop, TimerEngine::Type engineType = TimerEngine::Type::kOrderedSet);
     ~TimerQueue();
 
-    Timer* addTimer(TimerCallback callback, Timestamp when, Nanoseconds interval);
-    void cancelTimer(Timer* timer);
+    // 可以在任意线程中调用
+    TimerId addTimer(TimerCallback callback, Timestamp when, Nanoseconds interval);
+    // 定时器已经触发、已被取消或句柄无效时什么也不做
+    void cancelTimer(TimerId id);
+
+    // 切换保存定时器的数据结构，已有的定时器会迁移到新的引擎中
+    void setEngine(TimerEngine::Type engineType);
+    TimerEngine::Type engineType() const;
+
+    // precise为false时到期时刻最多被推迟1ms（timerfd最短1ms，epoll_wait按毫秒取整），为true时精确到微秒级
+    void setMode(Mode mode, bool precise = false);
+    Mode mode() const;
+    // kPollTimeout模式下距离最近到期时刻的时间，用作poll的超时；没有定时器或kTimerfd模式下为Poller::kPollForever
+    Nanoseconds pollTimeout() const;
+    // 执行所有已到期的定时器，kPollTimeout模式下由EventLoop在每次poll返回后调用
+    void runExpired();
 
 private:
-    using Entry = std::pair<Timestamp, Timer*>;
-    using TimerList = std::set<Entry>;
+    static const Channel::Handlers kChannelHandlers;
 
     void handleRead();
-    std::vector<Entry> getExpired(Timestamp now);
+    // 按引擎中最近的到期时刻重新设置timerfd_
+    void resetTimerfd();
+    void insert(TimerId id);
+    void cancel(TimerId id);
+
+    /**
+     * Timer对象保存在按块分配的槽位池中，块只增不减，空闲槽位通过nextFree串成链表，
+     * 稳态下添加与取消定时器不再经过全局的内存分配器。
+     * 槽位的分配与回收可能发生在不同线程，由slotMutex_保护空闲链表；
+     * 槽位内的Timer只在分配它的线程构造、之后只在loop线程中访问。
+    **/
+    struct Slot {
+        std::optional<Timer> timer;
+        // 槽位每回收一次加一，用于识别过期的TimerId
+        uint32_t generation = 0;
+        uint32_t nextFree = TimerId::kInvalidIndex;
+        // 定时器是否在engine_中，只在loop线程中访问
+        bool inEngine = false;
+    };
+
+    static const uint32_t kChunkBits = 10;
+    static const uint32_t kChunkSize = 1 << kChunkBits;
+    static const uint32_t kMaxChunks = 4096;
+
+    TimerId allocateSlot();
+    void releaseSlot(uint32_t index);
+    Slot& slotAt(uint32_t index);
 
 private:
     EventLoop* loop_;
     const int timerfd_;
     Channel timerChannel_;
-    TimerList timers_;
+    TimerEngine::Type engineType_;
+    Mode mode_;
+    bool precise_;
+    std::unique_ptr<TimerEngine> engine_;
+    // timerfd_当前设定的触发时刻，没有设定时为Timestamp::max()
+    Timestamp nextExpiration_;
+    std::vector<Timer*> expired_;
+
+    std::mutex slotMutex_;
+    // 块目录大小固定，已分配的块地址不会改变，其它线程分配新块时loop线程仍可无锁访问旧块
+    std::array<std::unique_ptr<Slot[]>, kMaxChunks> chunks_;
+    uint32_t slotCount_;
+    uint32_t freeHead_;
 };
 
 } // namespace ev
 
-} // namespace mudong
\ No newline at end of file
+} // namespace mudong
@@ -7,6 +7,7 @@ namespace mudong {
 namespace ev {
 
 using std::chrono::system_clock;
+using std::chrono::steady_clock;
 
 using Nanoseconds = std::chrono::nanoseconds;
 using Microseconds = std::chrono::microseconds;
@@ -16,15 +17,16 @@ using Minutes = std::chrono::minutes;
 using Hours = std::chrono::hours;
 
 // chrono中有system_clock和steady_clock两种时钟，第一种适合用来表示日期，时间戳用，第二种适合用来计算两者之间的相对时间间隔，不受系统时间调整的影响
-using Timestamp = std::chrono::time_point<system_clock, Nanoseconds>;
+// 定时器只关心相对时间，因此使用steady_clock（即CLOCK_MONOTONIC），NTP校时或手动修改系统时间不会导致定时器误触发
+using Timestamp = std::chrono::time_point<steady_clock, Nanoseconds>;
 
 namespace clock {
 
-inline Timestamp now() { return system_clock::now(); }
+inline Timestamp now() { return steady_clock::now(); }
 // 从当前时刻开始，时间流转一段长度后的时刻对应的时间戳
-inline Timestamp nowAfter(Nanoseconds interval) { return system_clock::now() + interval; }
+inline Timestamp nowAfter(Nanoseconds interval) { return steady_clock::now() + interval; }
 // 从当前时刻开始，时间倒退一段长度后的时刻对应的时间戳
-inline Timestamp nowBefore(Nanoseconds interval) { return system_clock::now() - interval; }
+inline Timestamp nowBefore(Nanoseconds interval) { return steady_clock::now() - interval; }
 
 } // namespace clock 
 
@@ -0,0 +1,221 @@
+#include <cassert>
+
+#include "TimingWheel.hpp"
+#include "Timer.hpp"
+
+using namespace mudong::ev;
+
+const int TimingWheel::kRootBits;
+const int TimingWheel::kLevelBits;
+const int TimingWheel::kLevels;
+const uint64_t TimingWheel::kRootSize;
+const uint64_t TimingWheel::kLevelSize;
+
+TimingWheel::TimingWheel(Nanoseconds resolution)
+        : resolution_(resolution),
+          start_(clock::now()),
+          currentTick_(0),
+          size_(0),
+          rootBitmap_{}
+{
+    assert(resolution_ > Nanoseconds::zero());
+}
+
+TimingWheel::~TimingWheel() {
+    assert(size_ == 0 && "timers should be taken out before TimingWheel destructing");
+}
+
+void TimingWheel::insert(Timer* timer) {
+    assert(timer->bucket_ == nullptr);
+    link(bucketFor(tickOf(timer->when())), timer);
+    ++size_;
+}
+
+void TimingWheel::erase(Timer* timer) {
+    if (timer->bucket_ == nullptr) {
+        return;
+    }
+    unlink(timer);
+    --size_;
+}
+
+bool TimingWheel::empty() const {
+    return size_ == 0;
+}
+
+Timestamp TimingWheel::nextExpiration() const {
+    assert(size_ > 0);
+    // 下一次下放发生在第0层转完一圈时，届时上层的定时器才会落到第0层
+    uint64_t next = (currentTick_ + kRootSize - 1) & ~(kRootSize - 1);
+    uint64_t start = currentTick_ & (kRootSize - 1);
+    for (uint64_t offset = 0; offset < kRootSize; ) {
+        uint64_t index = (start + offset) & (kRootSize - 1);
+        uint64_t bits = rootBitmap_[index / 64] >> (index % 64);
+        if (bits != 0) {
+            next = std::min(next, currentTick_ + offset + static_cast<uint64_t>(__builtin_ctzll(bits)));
+            break;
+        }
+        offset += 64 - index % 64;
+    }
+    return timeOf(next);
+}
+
+void TimingWheel::takeExpired(Timestamp now, std::vector<Timer*>& expired) {
+    if (now < start_) {
+        return;
+    }
+    uint64_t nowTick = static_cast<uint64_t>((now - start_) / resolution_);
+    if (size_ == 0) {
+        currentTick_ = std::max(currentTick_, nowTick + 1);
+        return;
+    }
+
+    std::vector<Timer*> notExpired;
+    while (currentTick_ <= nowTick) {
+        uint64_t index = currentTick_ & (kRootSize - 1);
+        if (index == 0) {
+            // 逐层下放，只有本层也恰好转完一圈时才需要继续处理更高一层
+            for (int level = 1; level < kLevels; ++level) {
+                int shift = kRootBits + (level - 1) * kLevelBits;
+                if (cascade(level, (currentTick_ >> shift) & (kLevelSize - 1)) != 0) {
+                    break;
+                }
+            }
+        }
+        Bucket& bucket = root_[index];
+        while (bucket.head != nullptr) {
+            Timer* timer = bucket.head;
+            unlink(timer);
+            if (timer->expired(now)) {
+                --size_;
+                expired.push_back(timer);
+            }
+            else {
+                notExpired.push_back(timer);
+            }
+        }
+        ++currentTick_;
+
+        // 跳过第0层中连续的空槽，但不能越过下一次下放的时刻
+        uint64_t boundary = (currentTick_ + kRootSize - 1) & ~(kRootSize - 1);
+        uint64_t target = std::min(boundary, nowTick + 1);
+        while (currentTick_ < target) {
+            uint64_t i = currentTick_ & (kRootSize - 1);
+            if (rootBitmap_[i / 64] & (1ULL << (i % 64))) {
+                break;
+            }
+            uint64_t bits = rootBitmap_[i / 64] >> (i % 64);
+            uint64_t skip = bits != 0 ? static_cast<uint64_t>(__builtin_ctzll(bits)) : 64 - i % 64;
+            currentTick_ = std::min(currentTick_ + skip, target);
+        }
+    }
+    for (Timer* timer : notExpired) {
+        link(bucketFor(tickOf(timer->when())), timer);
+    }
+}
+
+void TimingWheel::takeAll(std::vector<Timer*>& timers) {
+    auto drainBucket = [&](Bucket& bucket) {
+        while (bucket.head != nullptr) {
+            Timer* timer = bucket.head;
+            unlink(timer);
+            timers.push_back(timer);
+        }
+    };
+    for (auto& bucket : root_) {
+        drainBucket(bucket);
+    }
+    for (auto& level : levels_) {
+        for (auto& bucket : level) {
+            drainBucket(bucket);
+        }
+    }
+    size_ = 0;
+}
+
+uint64_t TimingWheel::tickOf(Timestamp when) const {
+    if (when <= start_) {
+        return 0;
+    }
+    auto ns = (when - start_).count();
+    auto res = resolution_.count();
+    return static_cast<uint64_t>((ns + res - 1) / res);
+}
+
+Timestamp TimingWheel::timeOf(uint64_t tick) const {
+    return start_ + resolution_ * static_cast<int64_t>(tick);
+}
+
+TimingWheel::Bucket& TimingWheel::bucketFor(uint64_t expireTick) {
+    if (expireTick < currentTick_) {
+        expireTick = currentTick_; // 已经到期，放到下一个要处理的槽中
+    }
+    uint64_t delta = expireTick - currentTick_;
+    if (delta < kRootSize) {
+        return root_[expireTick & (kRootSize - 1)];
+    }
+    for (int level = 1; level < kLevels; ++level) {
+        int shift = kRootBits + level * kLevelBits;
+        if (delta < (1ULL << shift)) {
+            return levels_[level - 1][(expireTick >> (shift - kLevelBits)) & (kLevelSize - 1)];
+        }
+    }
+    // 超出时间轮的范围，先挂在最高层最远的槽，下放时按真实的到期时刻重新插入
+    int shift = kRootBits + (kLevels - 1) * kLevelBits;
+    expireTick = currentTick_ + (1ULL << shift) - 1;
+    return levels_[kLevels - 2][(expireTick >> (shift - kLevelBits)) & (kLevelSize - 1)];
+}
+
+void TimingWheel::link(Bucket& bucket, Timer* timer) {
+    timer->bucket_ = &bucket;
+    timer->prev_ = nullptr;
+    timer->next_ = bucket.head;
+    if (bucket.head != nullptr) {
+        bucket.head->prev_ = timer;
+    }
+    bucket.head = timer;
+    if (&bucket >= root_.data() && &bucket < root_.data() + kRootSize) {
+        setRootBit(static_cast<uint64_t>(&bucket - root_.data()), true);
+    }
+}
+
+void TimingWheel::unlink(Timer* timer) {
+    auto bucket = static_cast<Bucket*>(timer->bucket_);
+    assert(bucket != nullptr);
+    if (timer->prev_ != nullptr) {
+        timer->prev_->next_ = timer->next_;
+    }
+    else {
+        bucket->head = timer->next_;
+    }
+    if (timer->next_ != nullptr) {
+        timer->next_->prev_ = timer->prev_;
+    }
+    timer->prev_ = timer->next_ = nullptr;
+    timer->bucket_ = nullptr;
+    if (bucket->head == nullptr && bucket >= root_.data() && bucket < root_.data() + kRootSize) {
+        setRootBit(static_cast<uint64_t>(bucket - root_.data()), false);
+    }
+}
+
+uint64_t TimingWheel::cascade(int level, uint64_t index) {
+    Bucket& bucket = levels_[static_cast<size_t>(level - 1)][index];
+    // 先摘下整条链表再逐个重新插入，避免重新落回同一个槽
+    Timer* timer = bucket.head;
+    bucket.head = nullptr;
+    while (timer != nullptr) {
+        Timer* next = timer->next_;
+        link(bucketFor(tickOf(timer->when())), timer);
+        timer = next;
+    }
+    return index;
+}
+
+void TimingWheel::setRootBit(uint64_t index, bool on) {
+    if (on) {
+        rootBitmap_[index / 64] |= 1ULL << (index % 64);
+    }
+    else {
+        rootBitmap_[index / 64] &= ~(1ULL << (index % 64));
+    }
+}
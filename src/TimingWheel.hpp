@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+
+#include "TimerEngine.hpp"
+
+namespace mudong {
+
+namespace ev {
+
+/**
+ * 分层时间轮：第0层256个槽，第1~3层各64个槽，以tick为单位覆盖约2^26个tick（1ms精度下约18.6小时），
+ * 更远的定时器先挂在最高层，到期检查时发现未到时间再重新插入。
+ * 每个槽是侵入式双向链表，插入与取消都是O(1)且不分配内存；时间推进到低层一圈结束时，
+ * 将上一层对应槽中的定时器下放（cascade）到更低的层。
+**/
+class TimingWheel: public TimerEngine {
+
+public:
+    explicit TimingWheel(Nanoseconds resolution = Milliseconds(1));
+    ~TimingWheel() override;
+
+    void insert(Timer* timer) override;
+    void erase(Timer* timer) override;
+    bool empty() const override;
+    Timestamp nextExpiration() const override;
+    void takeExpired(Timestamp now, std::vector<Timer*>& expired) override;
+    void takeAll(std::vector<Timer*>& timers) override;
+
+private:
+    static const int kRootBits = 8;
+    static const int kLevelBits = 6;
+    static const int kLevels = 4;
+    static const uint64_t kRootSize = 1 << kRootBits;
+    static const uint64_t kLevelSize = 1 << kLevelBits;
+
+    struct Bucket {
+        Timer* head = nullptr;
+    };
+
+    // 到期时刻向上取整到tick，保证定时器不会提前触发
+    uint64_t tickOf(Timestamp when) const;
+    Timestamp timeOf(uint64_t tick) const;
+    Bucket& bucketFor(uint64_t expireTick);
+    void link(Bucket& bucket, Timer* timer);
+    void unlink(Timer* timer);
+    // 将第level层的第index个槽中的定时器重新插入，返回index
+    uint64_t cascade(int level, uint64_t index);
+    void setRootBit(uint64_t index, bool on);
+
+    const Nanoseconds resolution_;
+    const Timestamp start_;
+    // 所有小于currentTick_的tick都已经处理过
+    uint64_t currentTick_;
+    size_t size_;
+    std::array<Bucket, kRootSize> root_;
+    std::array<std::array<Bucket, kLevelSize>, kLevels - 1> levels_;
+    // 第0层非空槽的位图，用于快速找到下一个需要处理的tick
+    std::array<uint64_t, kRootSize / 64> rootBitmap_;
+};
+
+} // namespace ev
+
+} // namespace mudong
@@ -0,0 +1,120 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <Acceptor.hpp>
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <iostream>
+#include <set>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+namespace {
+
+// 发起count个到addr的连接，loopback上在对端accept之前就已经进入backlog
+std::vector<int> connectClients(const InetAddress& addr, int count) {
+    std::vector<int> fds;
+    for (int i = 0; i < count; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        assert(fd != -1);
+        int ret = ::connect(fd, addr.getSockaddr(), addr.getSocklen());
+        assert(ret == 0);
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+// backlog中的连接按批取出：每轮事件循环最多accept batch个
+void testBatch(uint16_t port) {
+    EventLoop loop;
+    InetAddress addr(port, true);
+    Acceptor acceptor(&loop, addr);
+    const int kClients = 50;
+    const int kBatch = 16;
+    acceptor.setAcceptBatch(kBatch);
+
+    int accepted = 0;
+    std::set<Timestamp::rep> iterations; // 同一轮中的回调共用loop缓存的时间
+    acceptor.setNewConnectionCallback([&](int sockfd, const InetAddress&, const InetAddress&) {
+        ::close(sockfd);
+        iterations.insert(loop.now().time_since_epoch().count());
+        if (++accepted == kClients) {
+            loop.quit();
+        }
+    });
+    acceptor.listen();
+    std::vector<int> clients = connectClients(addr, kClients);
+    loop.runAfter(5s, [&]() { loop.quit(); });
+    loop.loop();
+
+    assert(accepted == kClients);
+    assert(iterations.size() == (kClients + kBatch - 1) / kBatch);
+    assert(acceptor.stats().accepted == kClients);
+    assert(acceptor.stats().rejected == 0);
+    for (int fd : clients) {
+        ::close(fd);
+    }
+    std::cout << kClients << " connections accepted in " << iterations.size() << " events" << std::endl;
+}
+
+// fd耗尽时连接被接受后立即关闭，监听fd不会一直可读导致空转
+void testFdExhaustion(uint16_t port) {
+    EventLoop loop;
+    InetAddress addr(port, true);
+    Acceptor acceptor(&loop, addr);
+    int accepted = 0;
+    acceptor.setNewConnectionCallback([&](int sockfd, const InetAddress&, const InetAddress&) {
+        ::close(sockfd);
+        ++accepted;
+    });
+    acceptor.listen();
+    const int kClients = 5;
+    std::vector<int> clients = connectClients(addr, kClients);
+
+    // 软限制设为最小的空闲fd，之后任何新fd都会EMFILE
+    struct rlimit saved;
+    int ret = ::getrlimit(RLIMIT_NOFILE, &saved);
+    assert(ret == 0);
+    int lowest = ::dup(0);
+    assert(lowest != -1);
+    ::close(lowest);
+    struct rlimit limited = saved;
+    limited.rlim_cur = static_cast<rlim_t>(lowest);
+    ret = ::setrlimit(RLIMIT_NOFILE, &limited);
+    assert(ret == 0);
+
+    loop.runEvery(1ms, [&]() {
+        if (acceptor.stats().rejected == kClients) {
+            loop.quit();
+        }
+    });
+    loop.runAfter(5s, [&]() { loop.quit(); });
+    loop.loop();
+    ret = ::setrlimit(RLIMIT_NOFILE, &saved);
+    assert(ret == 0);
+
+    assert(accepted == 0);
+    assert(acceptor.stats().rejected == kClients);
+    // 对端看到的是连接被关闭
+    for (int fd : clients) {
+        char c;
+        ssize_t n = ::read(fd, &c, 1);
+        assert(n <= 0);
+        ::close(fd);
+    }
+    std::cout << "rejected " << acceptor.stats().rejected << " connections under EMFILE" << std::endl;
+}
+
+} // anonymous namespace
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_FATAL);
+    testBatch(19901);
+    testFdExhaustion(19902);
+    std::cout << "test_Acceptor passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,172 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <BufferPool.hpp>
+#include <Buffer.hpp>
+#include <ChainBuffer.hpp>
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mudong::ev;
+
+namespace {
+
+// 按级别分配，用满一个arena之后才映射新的arena，释放后的块被复用
+void testSizeClasses() {
+    EventLoop loop;
+    BufferPool& pool = *loop.bufferPool();
+    assert(BufferPool::current() == &pool);
+
+    size_t capacity = 0;
+    void* small = pool.allocate(1, &capacity);
+    assert(capacity == BufferPool::kMinBlockSize);
+    void* medium = pool.allocate(3000, &capacity);
+    assert(capacity == 4096);
+    void* large = pool.allocate(BufferPool::kMaxBlockSize + 1, &capacity);
+    assert(capacity == BufferPool::kMaxBlockSize + 1);
+
+    BufferPool::Stats stats = pool.stats();
+    assert(stats.hits == 0 && stats.misses == 3);
+    assert(stats.mappedBytes == 2 * BufferPool::kArenaSize);
+    assert(stats.usedBytes == BufferPool::kMinBlockSize + 4096);
+    // 只有arena头部与切分过的块所在的页被写过
+    assert(stats.touchedBytes > stats.usedBytes && stats.touchedBytes < stats.mappedBytes);
+
+    pool.deallocate(small, BufferPool::kMinBlockSize);
+    void* again = pool.allocate(100, &capacity);
+    assert(again == small);
+    assert(pool.stats().hits == 1);
+    assert(pool.stats().touchedBytes == stats.touchedBytes);
+
+    pool.deallocate(again, BufferPool::kMinBlockSize);
+    pool.deallocate(medium, 4096);
+    pool.deallocate(large, BufferPool::kMaxBlockSize + 1);
+    assert(pool.stats().usedBytes == 0);
+    size_t trimmed = pool.trim();
+    assert(trimmed == 2 * BufferPool::kArenaSize);
+    assert(pool.stats().mappedBytes == 0);
+    assert(pool.stats().touchedBytes == 0);
+}
+
+// 其他线程释放的块在下一次trim时回到arena
+void testRemoteFree() {
+    EventLoop loop;
+    BufferPool& pool = *loop.bufferPool();
+
+    std::vector<void*> blocks;
+    size_t capacity;
+    const size_t perArena = (BufferPool::kArenaSize - 128) / BufferPool::kMaxBlockSize;
+    for (size_t i = 0; i < 2 * perArena; ++i) {
+        blocks.push_back(pool.allocate(BufferPool::kMaxBlockSize, &capacity));
+    }
+    assert(pool.stats().mappedBytes == 2 * BufferPool::kArenaSize);
+
+    std::thread other([&]() {
+        for (void* block : blocks) {
+            pool.deallocate(block, capacity);
+        }
+    });
+    other.join();
+    assert(pool.stats().usedBytes == blocks.size() * BufferPool::kMaxBlockSize);
+    size_t trimmed = pool.trim();
+    assert(trimmed == 2 * BufferPool::kArenaSize);
+    assert(pool.stats().usedBytes == 0);
+}
+
+// Buffer与ChainBuffer设置了池之后从池中分配，增长时换到更大的级别
+void testBuffers() {
+    EventLoop loop;
+    auto pool = loop.bufferPool();
+
+    Buffer buffer;
+    buffer.setPool(pool);
+    buffer.append("hello", 5);
+    assert(buffer.internalCapacity() == 2048);
+    std::string data(5000, 'x');
+    buffer.append(data);
+    assert(buffer.internalCapacity() == 8192);
+    std::string head = buffer.retrieveAsString(5);
+    assert(head == "hello");
+    std::string rest = buffer.retrieveAllAsString();
+    assert(rest == data);
+
+    ChainBuffer chain;
+    chain.setPool(pool);
+    chain.append(data);
+    assert(pool->stats().usedBytes == 8192 + ChainBuffer::kBlockBytes);
+
+    buffer.release();
+    chain.release();
+    assert(pool->stats().usedBytes == 0);
+    std::cout << "pool hits " << pool->stats().hits << ", misses " << pool->stats().misses << std::endl;
+}
+
+// 移到其他线程的Buffer增长时改用全局分配器；Buffer持有池的引用，可以比loop活得更久
+void testMovedBuffer() {
+    Buffer survivor;
+    {
+        EventLoop loop;
+        Buffer buffer;
+        buffer.setPool(loop.bufferPool());
+        buffer.append("hello", 5);
+        std::thread other([&]() {
+            Buffer moved(std::move(buffer));
+            assert(moved.pool() == loop.bufferPool());
+            moved.append(std::string(5000, 'x'));
+            assert(moved.pool() == nullptr);
+            std::string hello = moved.retrieveAsString(5);
+            assert(hello == "hello");
+        });
+        other.join();
+
+        Buffer pooled;
+        pooled.setPool(loop.bufferPool());
+        pooled.append("world", 5);
+        survivor = std::move(pooled);
+    }
+    assert(survivor.pool() != nullptr && survivor.pool().use_count() == 1);
+    std::string world = survivor.retrieveAllAsString();
+    assert(world == "world");
+    survivor.release();
+}
+
+// ChainBuffer同样可以移到其他线程继续追加，池中的块与全局分配的块混在一条链上，并且可以比loop活得更久
+void testMovedChainBuffer() {
+    ChainBuffer survivor;
+    const std::string data(2 * ChainBuffer::kBlockSize, 'x');
+    {
+        EventLoop loop;
+        ChainBuffer chain;
+        chain.setPool(loop.bufferPool());
+        chain.append(data);
+        assert(loop.bufferPool()->stats().usedBytes == 2 * ChainBuffer::kBlockBytes);
+        std::thread other([&]() {
+            ChainBuffer moved(std::move(chain));
+            moved.append(data);
+            survivor = std::move(moved);
+        });
+        other.join();
+        assert(loop.bufferPool()->stats().usedBytes == 2 * ChainBuffer::kBlockBytes);
+    }
+    assert(survivor.pool() != nullptr && survivor.pool().use_count() == 1);
+    std::string all = survivor.retrieveAllAsString();
+    assert(all == data + data);
+    survivor.release();
+}
+
+} // anonymous namespace
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_WARN);
+    testSizeClasses();
+    testRemoteFree();
+    testBuffers();
+    testMovedBuffer();
+    testMovedChainBuffer();
+    std::cout << "test_BufferPool passed" << std::endl;
+    return 0;
+}
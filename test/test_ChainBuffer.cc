@@ -0,0 +1,110 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <ChainBuffer.hpp>
+
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+
+namespace {
+
+std::string makeData(size_t len) {
+    std::string data(len, '\0');
+    for (size_t i = 0; i < len; ++i) {
+        data[i] = static_cast<char>(i % 251);
+    }
+    return data;
+}
+
+// 跨越多个块的追加与取出，头块的地址在增长时保持不变
+void testAppendRetrieve() {
+    ChainBuffer buffer;
+    assert(buffer.readableBytes() == 0);
+    assert(buffer.internalCapacity() == 0);
+
+    std::string data = makeData(3 * ChainBuffer::kBlockSize + 100);
+    buffer.append(data.data(), 10);
+    const char* head = buffer.peek();
+    buffer.append(data.data() + 10, data.size() - 10);
+    assert(buffer.peek() == head);
+    assert(buffer.readableBytes() == data.size());
+    assert(buffer.contiguousBytes() == ChainBuffer::kBlockSize);
+    assert(buffer.internalCapacity() == 4 * ChainBuffer::kBlockSize);
+
+    buffer.retrieve(ChainBuffer::kBlockSize - 3);
+    assert(buffer.contiguousBytes() == 3);
+    std::string middle = buffer.retrieveAsString(100);
+    assert(middle == data.substr(ChainBuffer::kBlockSize - 3, 100));
+    std::string rest = buffer.retrieveAllAsString();
+    assert(rest == data.substr(ChainBuffer::kBlockSize + 97));
+    assert(buffer.readableBytes() == 0);
+    // 最多保留一个空闲块
+    assert(buffer.internalCapacity() == ChainBuffer::kBlockSize);
+    buffer.release();
+    assert(buffer.internalCapacity() == 0);
+}
+
+// 整数恰好跨越块边界
+void testIntegers() {
+    ChainBuffer buffer;
+    std::string pad(ChainBuffer::kBlockSize - 3, 'x');
+    buffer.append(pad);
+    buffer.appendInt64(0x0102030405060708);
+    buffer.appendInt32(-2);
+    buffer.appendInt16(0x1234);
+    buffer.appendInt8(-1);
+    buffer.retrieve(pad.size());
+    assert(buffer.contiguousBytes() == 3);
+    int64_t i64 = buffer.readInt64();
+    assert(i64 == 0x0102030405060708);
+    int32_t i32 = buffer.readInt32();
+    assert(i32 == -2);
+    int16_t i16 = buffer.readInt16();
+    assert(i16 == 0x1234);
+    int8_t i8 = buffer.readInt8();
+    assert(i8 == -1);
+    assert(buffer.readableBytes() == 0);
+}
+
+// 通过管道用writev写出整条链，再用readv读回
+void testReadWriteFd() {
+    int fds[2];
+    int ret = ::pipe2(fds, O_NONBLOCK | O_CLOEXEC);
+    assert(ret == 0);
+
+    std::string data = makeData(2 * ChainBuffer::kBlockSize + 1234);
+    ChainBuffer output;
+    output.append(data);
+    int savedErrno = 0;
+    ssize_t n = output.writeFd(fds[1], &savedErrno);
+    assert(n == static_cast<ssize_t>(data.size()));
+    assert(output.readableBytes() == 0);
+
+    ChainBuffer input;
+    input.append(data.data(), 7);
+    while (input.readableBytes() < data.size() + 7) {
+        n = input.readFd(fds[0], &savedErrno);
+        assert(n > 0);
+    }
+    input.retrieve(7);
+    assert(input.retrieveAllAsString() == data);
+
+    n = input.readFd(fds[0], &savedErrno);
+    assert(n == -1 && savedErrno == EAGAIN);
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+} // anonymous namespace
+
+int main() {
+    testAppendRetrieve();
+    testIntegers();
+    testReadWriteFd();
+    std::cout << "test_ChainBuffer passed" << std::endl;
+    return 0;
+}
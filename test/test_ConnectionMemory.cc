@@ -0,0 +1,169 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <TcpConnection.hpp>
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+namespace {
+
+const size_t kMaxConnections = 5000;
+
+size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0, resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// 每个连接占两个fd（socketpair的两端），按fd上限决定能建立多少空闲连接
+size_t connectionLimit() {
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    size_t fds = limit.rlim_cur > 128 ? static_cast<size_t>(limit.rlim_cur) - 128 : 0;
+    return std::min(kMaxConnections, fds / 2);
+}
+
+/**
+ * 用socketpair建立一批已注册到epoll的空闲连接，所有连接共享同一张回调表，
+ * 统计建立前后RSS的差值，得到每个空闲连接的实际内存开销。空闲连接的两个Buffer都不应分配存储
+**/
+void testIdleConnectionMemory() {
+    EventLoop loop;
+    size_t count = connectionLimit();
+    assert(count > 0);
+
+    auto callbacks = std::make_shared<TcpConnectionCallbacks>();
+    callbacks->message = defaultMessageCallback;
+    callbacks->close = [](const TcpConnectionPtr&) {};
+
+    std::vector<TcpConnectionPtr> conns;
+    std::vector<int> peers;
+    conns.reserve(count);
+    peers.reserve(count);
+    InetAddress addr;
+
+    size_t before = residentBytes();
+    for (size_t i = 0; i < count; ++i) {
+        int fds[2];
+        int ret = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+        assert(ret == 0);
+        auto conn = std::make_shared<TcpConnection>(&loop, fds[0], addr, addr);
+        conn->setCallbacks(callbacks);
+        conn->connectEstablished();
+        conns.push_back(std::move(conn));
+        peers.push_back(fds[1]);
+    }
+    size_t after = residentBytes();
+
+    std::cout << "sizeof(Channel) = " << sizeof(Channel) << std::endl;
+    std::cout << "sizeof(TcpConnection) = " << sizeof(TcpConnection) << std::endl;
+    std::cout << count << " idle connections, RSS "
+              << static_cast<double>(after - before) / static_cast<double>(count)
+              << " bytes/connection" << std::endl;
+
+    assert(sizeof(Channel) <= 48);
+    assert(callbacks.use_count() == static_cast<long>(count) + 1);
+    for (auto& conn : conns) {
+        assert(conn->inputBuffer().internalCapacity() == 0);
+        assert(conn->outputBuffer().internalCapacity() == 0);
+    }
+
+    // 上下文槽按setContext的类型读取，类型不符时为nullptr
+    int context = 42;
+    conns[0]->setContext(&context);
+    assert(conns[0]->getContext<int>() == &context);
+    assert(conns[0]->getContext<long>() == nullptr);
+    assert(conns[1]->getContext<int>() == nullptr);
+
+    for (auto& conn : conns) {
+        conn->forceClose();
+    }
+    loop.runAfter(10ms, [&]() { loop.quit(); });
+    loop.loop();
+    for (auto& conn : conns) {
+        assert(conn->disconnected());
+    }
+    conns.clear();
+    for (int fd : peers) {
+        ::close(fd);
+    }
+}
+
+// 数据先读入loop共享的读缓冲区，回调只消费完整的行，剩余的半行才复制到连接的inputBuffer_，消费完后归还存储
+void testLeftoverInput() {
+    EventLoop loop;
+    int fds[2];
+    int ret = ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+    assert(ret == 0);
+
+    // 半行在回调返回后才复制到inputBuffer_，所以检查放到本轮的任务中进行；
+    // 第二段数据在看到第一行之后才写入，看到第二行后结束
+    std::vector<std::string> lines;
+    TcpConnectionPtr conn;
+    auto callbacks = std::make_shared<TcpConnectionCallbacks>();
+    callbacks->message = [&](const TcpConnectionPtr&, Buffer& buffer) {
+        size_t before = lines.size();
+        while (const char* eol = buffer.findEOL()) {
+            lines.emplace_back(buffer.peek(), eol);
+            buffer.retrieveUntil(eol + 1);
+        }
+        if (before == 0 && lines.size() == 1) {
+            loop.queueInLoop([&]() {
+                assert(lines[0] == "hello");
+                assert(conn->inputBuffer().readableBytes() == 3);
+                assert(conn->inputBuffer().internalCapacity() > 0);
+                ssize_t m = ::write(fds[1], "ld\n", 3);
+                assert(m == 3);
+            });
+        }
+        else if (before == 1 && lines.size() == 2) {
+            loop.queueInLoop([&]() {
+                assert(lines[1] == "world");
+                assert(conn->inputBuffer().readableBytes() == 0);
+                assert(conn->inputBuffer().internalCapacity() == 0);
+                conn->forceClose();
+                // 排在关闭任务之后
+                loop.queueInLoop([&]() { loop.quit(); });
+            });
+        }
+    };
+    callbacks->close = [](const TcpConnectionPtr&) {};
+    InetAddress addr;
+    conn = std::make_shared<TcpConnection>(&loop, fds[0], addr, addr);
+    conn->setCallbacks(callbacks);
+    conn->connectEstablished();
+
+    ssize_t n = ::write(fds[1], "hello\nwor", 9);
+    assert(n == 9);
+    loop.runAfter(5s, [&]() { loop.quit(); });
+    loop.loop();
+    assert(lines.size() == 2);
+    assert(conn->disconnected());
+    ::close(fds[1]);
+}
+
+} // anonymous namespace
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_WARN);
+    testIdleConnectionMemory();
+    testLeftoverInput();
+    std::cout << "test_ConnectionMemory passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,78 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <thread>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+// 跨线程的大量queueInLoop只应产生少量eventfd写入，且不丢任务
+void testWakeupCoalescing() {
+    const uint64_t kTasks = 10000;
+    EventLoop loop;
+    uint64_t executed = 0;
+
+    std::thread producer([&]() {
+        for (uint64_t i = 0; i < kTasks; ++i) {
+            loop.queueInLoop([&]() {
+                if (++executed == kTasks) {
+                    loop.quit();
+                }
+            });
+        }
+    });
+    loop.loop();
+    producer.join();
+
+    assert(executed == kTasks);
+    assert(loop.wakeupsWritten() + loop.wakeupsSaved() == kTasks);
+    std::cout << "wakeups written " << loop.wakeupsWritten() << ", saved " << loop.wakeupsSaved() << std::endl;
+}
+
+// 忙轮询模式下事件照常处理，并分别统计空转与阻塞的时间。
+// 唯一的事件是远晚于空转预算的定时器，每次等待必然先空转满预算再阻塞
+void testBusyPoll(Poller::Type type) {
+    EventLoop loop(type);
+    loop.setBusyPoll(1ms);
+    bool fired = false;
+    loop.runAfter(100ms, [&]() {
+        fired = true;
+        loop.quit();
+    });
+    loop.loop();
+
+    assert(fired);
+    assert(loop.spinTime() > Nanoseconds::zero());
+    assert(loop.blockedTime() > Nanoseconds::zero());
+    std::cout << Poller::typeName(type) << " busy poll: spin " << duration_cast<Microseconds>(loop.spinTime()).count()
+              << "us, blocked " << duration_cast<Microseconds>(loop.blockedTime()).count() << "us" << std::endl;
+}
+
+// fork出的子进程的tid与父进程不同，不能沿用父进程缓存的tid
+void testFork() {
+    EventLoop loop;
+    assert(loop.isInLoopThread());
+    pid_t pid = fork();
+    assert(pid != -1);
+    if (pid == 0) {
+        _exit(loop.isInLoopThread() ? 1 : 0);
+    }
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_INFO);
+    testWakeupCoalescing();
+    testBusyPoll(Poller::Type::kEPoll);
+    testBusyPoll(Poller::Type::kIoUring);
+    testFork();
+    std::cout << "test_EventLoop passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <MpscQueue.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace mudong::ev;
+
+// 统计全局分配次数
+std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main() {
+    const size_t kProducers = 4;
+    const size_t kItems = 100000;
+
+    MpscQueue<std::pair<size_t, size_t>> queue;
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < kProducers; ++i) {
+        producers.emplace_back([&queue, i]() {
+            for (size_t j = 0; j < kItems; ++j) {
+                queue.push({i, j});
+            }
+        });
+    }
+
+    // 同一个生产者的元素必须按入队顺序被取出
+    std::vector<size_t> expected(kProducers, 0);
+    size_t total = 0;
+    while (total < kProducers * kItems) {
+        total += queue.drain([&](std::pair<size_t, size_t>& item) {
+            assert(item.second == expected[item.first]);
+            ++expected[item.first];
+        });
+    }
+    for (auto& thread : producers) {
+        thread.join();
+    }
+    assert(queue.empty());
+    for (size_t count : expected) {
+        assert(count == kItems);
+    }
+
+    // 预先分配的节点用完之前，入队不经过内存分配器
+    const size_t kReserve = 64;
+    MpscQueue<int> reserved(kReserve);
+    size_t before = allocations.load();
+    for (int round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < kReserve; ++i) {
+            reserved.push(static_cast<int>(i));
+        }
+        size_t drained = reserved.drain([](int&) {});
+        assert(drained == kReserve);
+    }
+    assert(allocations.load() == before);
+
+    // 析构时释放未取出的节点
+    MpscQueue<std::string> leftover;
+    leftover.push(std::string("not drained"));
+
+    std::cout << "test_MpscQueue passed" << std::endl;
+    return 0;
+}
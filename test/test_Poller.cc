@@ -0,0 +1,126 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <EventLoop.hpp>
+#include <Channel.hpp>
+#include <Logger.hpp>
+
+#include <memory>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+// 在指定后端上验证读事件、事件修改、跨线程唤醒与定时器
+void testPoller(Poller::Type type) {
+    EventLoop loop(type);
+    std::cout << "testing " << Poller::typeName(loop.pollerType()) << std::endl;
+
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds);
+    assert(ret == 0);
+
+    int reads = 0;
+    Channel channel(&loop, fds[0]);
+    std::function<void()> onRead = [&]() {
+        char buf[16];
+        ssize_t n = ::read(fds[0], buf, sizeof(buf));
+        assert(n > 0);
+        if (++reads == 1) {
+            // 暂停读后再写入的数据不应触发回调，直到重新打开读
+            channel.disableRead();
+            ssize_t m = ::write(fds[1], "b", 1);
+            assert(m == 1);
+            loop.runAfter(20ms, [&]() {
+                assert(reads == 1);
+                channel.enableRead();
+            });
+        }
+        else {
+            loop.quit();
+        }
+    };
+    static const Channel::Handlers handlers = {
+        [](void* owner) { (*static_cast<std::function<void()>*>(owner))(); },
+        nullptr,
+        nullptr,
+        nullptr,
+        nullptr
+    };
+    channel.setHandlers(&handlers, &onRead);
+    channel.enableRead();
+
+    std::thread writer([&]() {
+        std::this_thread::sleep_for(10ms);
+        loop.queueInLoop([&]() {
+            ssize_t n = ::write(fds[1], "a", 1);
+            assert(n == 1);
+        });
+    });
+
+    loop.loop();
+    writer.join();
+    assert(reads == 2);
+
+    channel.disableAll();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// 一轮中注册的Channel多于提交队列的容量，提交队列写满时先交给内核再继续，每个Channel的事件都能收到
+void testManyChannels(Poller::Type type) {
+    EventLoop loop(type);
+    const int kPairs = 300;
+    static const Channel::Handlers handlers = {
+        [](void* owner) { (*static_cast<std::function<void()>*>(owner))(); },
+        nullptr,
+        nullptr,
+        nullptr,
+        nullptr
+    };
+
+    std::vector<int> fds(2 * kPairs);
+    std::vector<std::unique_ptr<Channel>> channels;
+    std::vector<std::function<void()>> onReads(kPairs);
+    int reads = 0;
+    for (int i = 0; i < kPairs; ++i) {
+        int ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, &fds[2 * i]);
+        assert(ret == 0);
+        ssize_t n = ::write(fds[2 * i + 1], "a", 1);
+        assert(n == 1);
+        int fd = fds[2 * i];
+        channels.push_back(std::make_unique<Channel>(&loop, fd));
+        Channel* channel = channels.back().get();
+        onReads[i] = [&, fd, channel]() {
+            char c;
+            ssize_t m = ::read(fd, &c, 1);
+            assert(m == 1);
+            channel->disableAll();
+            if (++reads == kPairs) {
+                loop.quit();
+            }
+        };
+        channel->setHandlers(&handlers, &onReads[i]);
+        channel->enableRead();
+    }
+    loop.runAfter(5s, [&]() { loop.quit(); });
+    loop.loop();
+    assert(reads == kPairs);
+
+    for (int fd : fds) {
+        close(fd);
+    }
+    std::cout << Poller::typeName(loop.pollerType()) << " delivered events for " << kPairs << " channels" << std::endl;
+}
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_INFO);
+    testPoller(Poller::Type::kEPoll);
+    testPoller(Poller::Type::kIoUring);
+    testManyChannels(Poller::Type::kEPoll);
+    testManyChannels(Poller::Type::kIoUring);
+    std::cout << "test_Poller passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <Task.hpp>
+#include <ThreadPool.hpp>
+#include <EventLoop.hpp>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <iostream>
+
+using namespace mudong::ev;
+
+namespace {
+
+// 记录存活对象个数，检查移动与析构没有泄漏或重复析构
+struct Counted {
+    static int alive;
+
+    Counted() { ++alive; }
+    Counted(const Counted&) { ++alive; }
+    Counted(Counted&&) noexcept { ++alive; }
+    ~Counted() { --alive; }
+};
+int Counted::alive = 0;
+
+void testInlineAndHeap() {
+    int calls = 0;
+    {
+        // 与TcpConnection::send中相同的捕获，应当内联存储
+        auto ptr = std::make_shared<int>(1);
+        Task small([ptr, str = std::string("data"), counted = Counted()]() mutable { str += "!"; });
+        Task moved(std::move(small));
+        assert(!small);
+        assert(moved);
+        moved();
+
+        std::array<char, 256> big{};
+        Task large([&calls, big, counted = Counted()]() { calls += big[0] + 1; });
+        Task other;
+        other = std::move(large);
+        assert(!large);
+        other();
+        assert(Counted::alive == 2);
+
+        other = std::move(moved); // 赋值时析构原有的对象
+        assert(Counted::alive == 1);
+        other = nullptr;
+        assert(Counted::alive == 0);
+    }
+    assert(Counted::alive == 0);
+    assert(calls == 1);
+}
+
+// 只能移动的捕获可以通过ThreadPool与EventLoop执行
+void testMoveOnly() {
+    std::atomic_int sum(0);
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 1000; ++i) {
+            pool.runTask([value = std::make_unique<int>(i), &sum]() { sum += *value; });
+        }
+        while (sum.load() != 999 * 1000 / 2) {
+            std::this_thread::yield();
+        }
+    }
+
+    EventLoop loop;
+    int got = 0;
+    loop.queueInLoop([value = std::make_unique<int>(42), &got]() { got = *value; });
+    loop.queueInLoop([&loop]() { loop.quit(); });
+    loop.wakeup(); // loop线程中入队不会唤醒，避免第一次poll一直阻塞
+    loop.loop();
+    assert(got == 42);
+}
+
+} // anonymous namespace
+
+int main() {
+    testInlineAndHeap();
+    testMoveOnly();
+    std::cout << "test_Task passed" << std::endl;
+    return 0;
+}
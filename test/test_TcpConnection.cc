@@ -0,0 +1,569 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <TcpServer.hpp>
+#include <TcpClient.hpp>
+#include <TcpConnection.hpp>
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <sched.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+namespace {
+
+const size_t kPayloadSize = 8 * 1024 * 1024;
+
+struct EchoOptions {
+    Poller::Type pollerType = Poller::Type::kEPoll;
+    bool edgeTriggered = false;
+};
+
+std::string makePayload() {
+    std::string payload(kPayloadSize, '\0');
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>(i % 251);
+    }
+    return payload;
+}
+
+/**
+ * 每个测试的服务端与客户端共用一个loop：先配置server，再调用run。
+ * run返回前在loop线程中断开客户端，服务端剩下的连接随TcpServer析构断开
+**/
+struct Fixture {
+    explicit Fixture(uint16_t port, Poller::Type pollerType = Poller::defaultType())
+            : loop(pollerType),
+              addr(port, true),
+              server(&loop, addr)
+    {}
+
+    /**
+     * 启动服务端与clients个客户端，连上后各自发送request（为空则不发送），收到的数据都追加到received。
+     * 每次收到数据、客户端断开以及每10ms检查一次until，返回true或超过timeout时结束，返回until是否满足
+    **/
+    bool run(const std::string& request, const std::function<bool()>& until,
+             Nanoseconds timeout = 20s, int clients = 1) {
+        server.start();
+        bool done = false;
+        auto check = [&]() {
+            if (!done && until()) {
+                done = true;
+                loop.quit();
+            }
+        };
+        std::vector<std::unique_ptr<TcpClient>> clientList;
+        for (int i = 0; i < clients; ++i) {
+            auto client = std::make_unique<TcpClient>(&loop, addr);
+            client->setConnectionCallback([&](const TcpConnectionPtr& conn) {
+                if (conn->connected()) {
+                    clientConn = conn;
+                    if (!request.empty()) {
+                        conn->send(request);
+                    }
+                }
+                else {
+                    ++clientsClosed;
+                    check();
+                }
+            });
+            client->setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+                received.append(buffer.peek(), buffer.readableBytes());
+                buffer.retrieveAll();
+                check();
+            });
+            client->start();
+            clientList.push_back(std::move(client));
+        }
+        TimerId poll = loop.runEvery(10ms, check);
+        TimerId expire = loop.runAfter(timeout, [&]() { loop.quit(); });
+        loop.loop();
+        loop.cancelTimer(poll);
+        loop.cancelTimer(expire);
+        return done;
+    }
+
+    EventLoop loop;
+    InetAddress addr;
+    TcpServer server;
+    std::string received;
+    // 最近连上的客户端连接
+    TcpConnectionPtr clientConn;
+    int clientsClosed = 0;
+};
+
+// 客户端发送大块数据，服务端原样回显，写满socket缓冲区以覆盖outputBuffer_与可写事件的路径
+void testEcho(const EchoOptions& options, uint16_t port) {
+    Fixture f(port, options.pollerType);
+    f.server.setEdgeTriggered(options.edgeTriggered);
+    f.server.setMessageCallback([](const TcpConnectionPtr& conn, Buffer& buffer) {
+        conn->send(buffer);
+    });
+
+    const std::string payload = makePayload();
+    bool ok = f.run(payload, [&]() { return f.received.size() == payload.size(); });
+    assert(ok);
+    assert(f.received == payload);
+    std::cout << Poller::typeName(options.pollerType) << (options.edgeTriggered ? " ET" : " LT")
+              << " echo " << f.received.size() << " bytes" << std::endl;
+}
+
+// 服务端开启读空闲超时：不发数据的连接在超时后一个tick内被关闭，持续发送数据的连接不受影响
+void testIdleTimeout(uint16_t port) {
+    Fixture f(port);
+    const Nanoseconds kTimeout = 100ms;
+    f.server.setIdleTimeout(kTimeout);
+    int idleCount = 0;
+    f.server.setIdleCallback([&](const TcpConnectionPtr& conn, IdleKind kind) {
+        assert(kind == IdleKind::kRead);
+        ++idleCount;
+        conn->forceClose();
+    });
+    f.server.start();
+
+    // 两个客户端行为不同，不经过Fixture::run创建
+    Timestamp start = f.loop.now();
+    Timestamp silentClosed = Timestamp::max();
+    TcpClient silent(&f.loop, f.addr);
+    silent.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if (!conn->connected()) {
+            silentClosed = clock::now();
+        }
+    });
+    silent.start();
+
+    bool chattyClosed = false;
+    TcpConnectionPtr chattyConn;
+    TcpClient chatty(&f.loop, f.addr);
+    chatty.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            chattyConn = conn;
+        }
+        else chattyClosed = true;
+    });
+    chatty.start();
+    f.loop.runEvery(20ms, [&]() {
+        if (chattyConn && chattyConn->connected()) {
+            chattyConn->send("ping");
+        }
+    });
+    f.run("", []() { return false; }, 400ms, 0);
+
+    assert(idleCount == 1);
+    assert(!chattyClosed);
+    assert(silentClosed >= start + kTimeout);
+    assert(silentClosed <= start + kTimeout + 50ms);
+    std::cout << "idle connection closed after "
+              << duration_cast<Milliseconds>(silentClosed - start).count() << " ms" << std::endl;
+}
+
+// 收到完整的response后再请求一次，共收到两次时返回true
+std::function<bool()> expectTwice(Fixture& f, const std::string& response) {
+    return [&f, response, responses = 0]() mutable {
+        if (f.received.size() != response.size()) {
+            return false;
+        }
+        assert(f.received == response);
+        f.received.clear();
+        if (++responses == 2) {
+            return true;
+        }
+        f.clientConn->send("GET");
+        return false;
+    };
+}
+
+// 服务端在send的数据之间插入文件，客户端收到的字节序列与调用顺序一致；第二次请求命中loop的文件缓存
+void testSendFile(bool edgeTriggered, uint16_t port) {
+    Fixture f(port);
+    f.loop.setFileCache(4);
+
+    char path[] = "/tmp/test_sendfile_XXXXXX";
+    int fd = ::mkstemp(path);
+    assert(fd != -1);
+    const std::string payload = makePayload().substr(0, 3 * 1024 * 1024 + 17);
+    ssize_t written = ::write(fd, payload.data(), payload.size());
+    assert(written == static_cast<ssize_t>(payload.size()));
+
+    f.server.setEdgeTriggered(edgeTriggered);
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        conn->send("HDR");
+        bool sent = conn->sendFile(path);
+        assert(sent);
+        conn->send("MID");
+        conn->sendFile(fd, 100, 1000);
+        conn->send("TAIL");
+    });
+
+    const std::string response = "HDR" + payload + "MID" + payload.substr(100, 1000) + "TAIL";
+    bool ok = f.run("GET", expectTwice(f, response));
+    assert(ok);
+    ::close(fd);
+    ::unlink(path);
+    assert(f.loop.fileCache()->hits() == 1 && f.loop.fileCache()->misses() == 1);
+    std::cout << (edgeTriggered ? "ET" : "LT") << " sendFile " << payload.size() << " bytes" << std::endl;
+}
+
+// sendfile不能读管道：按fd发送时直接拒绝；绕过检查的管道在直接发送或排队发送时出错，连接随即关闭，之后的数据不再发送
+void testSendFileError(bool corked, uint16_t port) {
+    Fixture f(port);
+    int pipefds[2];
+    int ret = ::pipe2(pipefds, O_CLOEXEC);
+    assert(ret == 0);
+    ssize_t n = ::write(pipefds[1], "0123456789", 10);
+    assert(n == 10);
+
+    bool rejected = false;
+    f.server.setCorked(corked);
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        rejected = !conn->sendFile(pipefds[0], 0, 10);
+        conn->send("HDR");
+        conn->sendFile(std::make_shared<FileHandle>(::dup(pipefds[0]), 10), 0, 10);
+        conn->send("TAIL");
+    });
+
+    bool ok = f.run("GET", [&]() { return f.clientsClosed == 1; }, 5s);
+    assert(ok);
+    assert(rejected);
+    assert(f.received == "HDR");
+    ::close(pipefds[0]);
+    ::close(pipefds[1]);
+    std::cout << (corked ? "queued" : "direct") << " sendFile error closed the connection" << std::endl;
+}
+
+// 开启零拷贝后大块数据从共享的payload直接发送，完成通知到达后连接释放对payload的引用
+void testZeroCopy(uint16_t port) {
+    Fixture f(port);
+    auto payload = std::make_shared<const std::string>(makePayload());
+    TcpConnectionPtr serverConn;
+    f.server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            serverConn = conn;
+            bool enabled = conn->enableZeroCopy();
+            assert(enabled);
+        }
+    });
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        conn->send("HDR");
+        conn->sendZeroCopy(payload);
+        // 小于阈值的数据退回拷贝发送，不进入完成通知的等待
+        conn->sendZeroCopy(std::make_shared<const std::string>("TAIL"));
+    });
+
+    const std::string response = "HDR" + *payload + "TAIL";
+    bool ok = f.run("GET", [&]() {
+        return f.received.size() == response.size() && serverConn->zeroCopyInflight() == 0;
+    });
+    assert(ok);
+    assert(f.received == response);
+    assert(payload.use_count() == 1);
+    std::cout << "zero copy " << payload->size() << " bytes, "
+              << serverConn->zeroCopyCopied() << " send(s) copied by kernel" << std::endl;
+}
+
+// 客户端暂停读取时服务端零拷贝发送后立即关闭：内核还没发完的内存由loop保留，客户端读完之后才释放
+void testZeroCopyLinger(uint16_t port) {
+    Fixture f(port);
+    auto payload = std::make_shared<const std::string>(makePayload());
+    size_t lingered = 0;
+    f.server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            bool enabled = conn->enableZeroCopy();
+            assert(enabled);
+        }
+        else {
+            lingered = f.loop.lingering();
+            f.clientConn->startRead();
+        }
+    });
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        f.clientConn->stopRead();
+        conn->sendZeroCopy(payload);
+        conn->forceClose();
+    });
+
+    bool ok = f.run("GET", [&]() {
+        return f.clientsClosed == 1 && f.loop.lingering() == 0 && payload.use_count() == 1;
+    });
+    assert(ok);
+    assert(lingered == 1);
+    assert(!f.received.empty());
+    assert(f.received.size() < payload->size());
+    assert(payload->compare(0, f.received.size(), f.received) == 0);
+    std::cout << "zero copy linger released after " << f.received.size() << " bytes" << std::endl;
+}
+
+// 头部、正文与尾部分段发送：第一段回应通常一次writev写完，正文较大时剩余部分逐段进入outputBuffer_
+void testScatterSend(uint16_t port) {
+    Fixture f(port);
+    const std::string body = makePayload();
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        std::string_view small[] = {"HDR", "", "small"};
+        conn->send(small);
+        std::string_view large[] = {"HDR", body, "TAIL"};
+        conn->send(large);
+        struct iovec vec[2] = {{const_cast<char*>("A"), 1}, {const_cast<char*>("BC"), 2}};
+        conn->send(vec, 2);
+    });
+
+    const std::string response = "HDRsmallHDR" + body + "TAILABC";
+    bool ok = f.run("GET", [&]() { return f.received.size() == response.size(); });
+    assert(ok);
+    assert(f.received == response);
+    std::cout << "scatter send " << f.received.size() << " bytes" << std::endl;
+}
+
+// 工作线程把数据的所有权交给连接所在的loop：string与Buffer被移走，共享的payload只增加引用
+void testMoveSend(uint16_t port) {
+    Fixture f(port);
+    auto shared = std::make_shared<const std::string>("SHARED");
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        std::thread worker([&]() {
+            // 回调中的请求缓冲区被移走存储后，连接与loop的读缓冲区照常使用
+            conn->send(std::move(buffer));
+            assert(buffer.readableBytes() == 0);
+            std::string str = makePayload();
+            conn->send(std::move(str));
+            assert(str.empty());
+            Buffer out;
+            out.append("BUFFER", 6);
+            conn->send(std::move(out));
+            assert(out.readableBytes() == 0 && out.internalCapacity() == 0);
+            conn->send(shared);
+            conn->send("END");
+        });
+        worker.join();
+    });
+
+    const std::string response = "GET" + makePayload() + "BUFFERSHAREDEND";
+    bool ok = f.run("GET", expectTwice(f, response));
+    assert(ok);
+    assert(shared.use_count() == 1);
+    std::cout << "move send " << response.size() << " bytes twice" << std::endl;
+}
+
+// 合并写：一次回调中的多次send在本轮结束时一次写出，紧随其后的半关闭等数据写完才生效
+void testCorked(uint16_t port) {
+    Fixture f(port);
+    const int kFrames = 10;
+    f.server.setCorked(true);
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        for (int i = 0; i < kFrames; ++i) {
+            conn->send("frame " + std::to_string(i) + "\n");
+        }
+        assert(conn->outputBuffer().readableBytes() > 0);
+        conn->shutdown();
+    });
+
+    std::string expected;
+    for (int i = 0; i < kFrames; ++i) {
+        expected += "frame " + std::to_string(i) + "\n";
+    }
+    bool ok = f.run("GET", [&]() { return f.clientsClosed == 1; }, 5s);
+    assert(ok);
+    assert(f.received == expected);
+    assert(f.loop.corkedSends() == kFrames);
+    assert(f.loop.corkedWrites() == 1);
+    std::cout << "corked " << f.loop.corkedSends() << " sends into "
+              << f.loop.corkedWrites() << " write(s)" << std::endl;
+}
+
+// 回应积压超过高水位时服务端暂停读取，对端读走数据、积压降到低水位以下后恢复
+void testOutputWatermark(uint16_t port) {
+    Fixture f(port);
+    FlowControl flowControl;
+    flowControl.outputHighWater = 64 * 1024;
+    flowControl.outputLowWater = 16 * 1024;
+    const std::string payload = makePayload();
+    bool pausedAfterSend = false;
+    size_t queuedAfterSend = 0;
+    int requests = 0;
+    f.server.setFlowControl(flowControl);
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        buffer.retrieveAll();
+        if (++requests == 1) {
+            conn->send(payload);
+            pausedAfterSend = !conn->isReading();
+            queuedAfterSend = f.loop.queuedOutputBytes();
+            assert(queuedAfterSend == conn->pendingOutputBytes());
+        }
+        else conn->send("OK");
+    });
+
+    bool pinged = false;
+    bool ok = f.run("GET", [&]() {
+        if (f.received.size() == payload.size() && !pinged) {
+            pinged = true;
+            f.clientConn->send("PING");
+        }
+        return f.received.size() == payload.size() + 2;
+    });
+    assert(ok);
+    assert(pausedAfterSend);
+    assert(queuedAfterSend >= flowControl.outputHighWater);
+    assert(f.loop.queuedOutputBytes() == 0);
+    assert(requests == 2);
+    assert(f.received == payload + "OK");
+    std::cout << "output watermark paused and resumed reading" << std::endl;
+}
+
+// 回调每次只消费一帧：超过输入限额时暂停读取并继续处理已缓冲的数据；关闭策略下直接断开。
+// userPause时回调中成对调用stopRead/startRead，不能解除输入超限的暂停
+void testInputLimit(InputLimitPolicy policy, bool userPause, uint16_t port) {
+    Fixture f(port);
+    const size_t kFrame = 100;
+    const size_t kTotal = 200 * kFrame;
+    FlowControl flowControl;
+    flowControl.inputLimit = 10 * kFrame;
+    flowControl.inputPolicy = policy;
+    size_t consumed = 0;
+    size_t maxBuffered = 0;
+    f.server.setFlowControl(flowControl);
+    f.server.setMessageCallback([&](const TcpConnectionPtr& conn, Buffer& buffer) {
+        maxBuffered = std::max(maxBuffered, conn->inputBuffer().readableBytes());
+        if (buffer.readableBytes() >= kFrame) {
+            buffer.retrieve(kFrame);
+            consumed += kFrame;
+        }
+        if (userPause) {
+            conn->stopRead();
+            conn->startRead();
+        }
+    });
+
+    bool ok = f.run(std::string(kTotal, 'x'), [&]() {
+        return consumed == kTotal || f.clientsClosed == 1;
+    }, 5s);
+    assert(ok);
+    if (policy == InputLimitPolicy::kPauseRead) {
+        assert(consumed == kTotal);
+        assert(f.clientsClosed == 0);
+        // 暂停之后只会再多读一次socket
+        assert(maxBuffered < flowControl.inputLimit + 64 * 1024);
+        std::cout << "input limit paused reading" << (userPause ? " under stopRead/startRead" : "")
+                  << ", consumed " << consumed << " bytes" << std::endl;
+    }
+    else {
+        assert(f.clientsClosed == 1);
+        assert(consumed < kTotal);
+        std::cout << "input limit closed connection after " << consumed << " bytes" << std::endl;
+    }
+}
+
+// 开启CPU亲和后每个loop线程只运行在一个CPU上，SO_REUSEPORT组挂上按CPU分流的程序后连接照常建立
+void testCpuAffinity(uint16_t port) {
+    cpu_set_t saved;
+    int ret = sched_getaffinity(0, sizeof(saved), &saved);
+    assert(ret == 0);
+    const size_t kThreads = std::min<size_t>(static_cast<size_t>(CPU_COUNT(&saved)), 4);
+    const int kClients = 8;
+
+    {
+        Fixture f(port);
+        f.server.setNumThread(kThreads);
+        f.server.setCpuAffinity(true);
+        std::atomic_int pinned(0);
+        f.server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+            cpu_set_t set;
+            if (sched_getaffinity(0, sizeof(set), &set) == 0 && conn->connected() && CPU_COUNT(&set) == 1) {
+                ++pinned;
+            }
+        });
+        bool ok = f.run("", [&]() { return pinned == kClients; }, 5s, kClients);
+        assert(ok);
+        assert(f.server.acceptStats().accepted == kClients);
+    }
+
+    // 单独检查cBPF程序能挂到监听socket上
+    {
+        EventLoop loop;
+        TcpServerSingle single(&loop, InetAddress(port + 1, true));
+        single.start();
+        bool attached = single.attachCpuSteering({0, 1});
+        assert(attached);
+    }
+    ret = sched_setaffinity(0, sizeof(saved), &saved);
+    assert(ret == 0);
+    std::cout << kThreads << " loop thread(s) pinned, " << kClients << " connections accepted" << std::endl;
+}
+
+// 主从Reactor模式：只有baseLoop accept，按balancer把连接分给各loop，返回全部连上时各loop的连接数
+std::vector<size_t> runBalanced(const LoadBalancer& balancer, uint16_t port) {
+    const int kClients = 8;
+    Fixture f(port);
+    f.server.setNumThread(4);
+    f.server.setLoadBalancer(balancer);
+    std::atomic_int connected(0);
+    f.server.setConnectionCallback([&](const TcpConnectionPtr& conn) {
+        if (conn->connected()) {
+            ++connected;
+        }
+    });
+    std::vector<size_t> counts;
+    bool ok = f.run("", [&]() {
+        if (connected < kClients) {
+            return false;
+        }
+        counts = f.server.connectionCounts();
+        return true;
+    }, 5s, kClients);
+    assert(ok);
+    assert(f.server.acceptStats().accepted == kClients);
+    return counts;
+}
+
+void testLoadBalance(uint16_t port) {
+    const std::vector<size_t> even = {2, 2, 2, 2};
+    std::vector<size_t> roundRobin = runBalanced(roundRobinBalancer(), port);
+    assert(roundRobin == even);
+    std::vector<size_t> leastConnections = runBalanced(leastConnectionsBalancer(), port);
+    assert(leastConnections == even);
+    // 连接都还没有收发数据，待发送字节数相同时按连接数选择
+    std::vector<size_t> leastQueuedBytes = runBalanced(leastQueuedBytesBalancer(), port);
+    assert(leastQueuedBytes == even);
+    std::vector<size_t> counts = runBalanced([](const std::vector<LoopLoad>& loads) {
+        assert(loads.size() == 4);
+        return size_t(2);
+    }, port);
+    assert((counts == std::vector<size_t>{0, 0, 8, 0}));
+}
+
+} // anonymous namespace
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_WARN);
+    testEcho({Poller::Type::kEPoll, false}, 19801);
+    testEcho({Poller::Type::kEPoll, true}, 19802);
+    testEcho({Poller::Type::kIoUring, false}, 19803);
+    testIdleTimeout(19804);
+    testSendFile(false, 19805);
+    testSendFile(true, 19806);
+    testSendFileError(false, 19818);
+    testSendFileError(true, 19819);
+    testZeroCopy(19807);
+    testZeroCopyLinger(19820);
+    testScatterSend(19808);
+    testMoveSend(19809);
+    testCorked(19810);
+    testOutputWatermark(19811);
+    testInputLimit(InputLimitPolicy::kPauseRead, false, 19812);
+    testInputLimit(InputLimitPolicy::kClose, false, 19813);
+    testInputLimit(InputLimitPolicy::kPauseRead, true, 19817);
+    testCpuAffinity(19814);
+    testLoadBalance(19816);
+    std::cout << "test_TcpConnection passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,106 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <ThreadPlacement.hpp>
+#include <ThreadPool.hpp>
+#include <TcpServer.hpp>
+#include <EventLoop.hpp>
+#include <Logger.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+namespace {
+
+// 调用线程只允许在cpu上运行
+bool pinnedTo(int cpu) {
+    cpu_set_t set;
+    int ret = sched_getaffinity(0, sizeof(set), &set);
+    assert(ret == 0);
+    return CPU_COUNT(&set) == 1 && CPU_ISSET(cpu, &set);
+}
+
+// 调用线程的内存策略是否为优先从node分配
+bool preferredNode(int node) {
+    int mode = -1;
+    unsigned long mask = 0;
+    long ret = ::syscall(SYS_get_mempolicy, &mode, &mask, 8 * sizeof(mask) + 1, nullptr, 0);
+    assert(ret == 0);
+    return mode == 1 && mask == 1UL << node;
+}
+
+void testTopology() {
+    std::vector<int> cpus = allowedCpus();
+    assert(!cpus.empty());
+    for (int cpu : cpus) {
+        assert(numaNodeOfCpu(cpu) >= -1);
+    }
+    assert(numaNodeOfCpu(CPU_SETSIZE) == -1);
+}
+
+// 工作线程在ThreadInitCallback之前已经完成绑定
+void testThreadPool() {
+    const int cpu = allowedCpus().back();
+    const int node = numaNodeOfCpu(cpu);
+    std::atomic_int placed(0);
+    {
+        ThreadPool pool(2, 16, [&](size_t index) {
+            if (pinnedTo(cpu) && (node < 0 || preferredNode(node))) {
+                ++placed;
+            }
+        }, [&](size_t index) {
+            return ThreadPlacement{{cpu}, node};
+        });
+    }
+    assert(placed == 2);
+}
+
+// loop线程按placement绑定，setNumaLocal补上CPU所在的节点，0号为调用者线程
+void testTcpServer() {
+    cpu_set_t saved;
+    int ret = sched_getaffinity(0, sizeof(saved), &saved);
+    assert(ret == 0);
+    const int cpu = allowedCpus().front();
+    const int node = numaNodeOfCpu(cpu);
+    const size_t kThreads = 3;
+
+    std::atomic_int placed(0);
+    {
+        EventLoop loop;
+        TcpServer server(&loop, InetAddress(19950, true));
+        server.setNumThread(kThreads);
+        server.setThreadPlacement([&](size_t index) {
+            return ThreadPlacement{{cpu}, -1};
+        });
+        server.setNumaLocal(true);
+        server.setThreadInitCallback([&](size_t index) {
+            if (pinnedTo(cpu) && (node < 0 || preferredNode(node))) {
+                ++placed;
+            }
+        });
+        server.start();
+        loop.runAfter(100ms, [&]() { loop.quit(); });
+        loop.loop();
+    }
+    assert(placed == kThreads);
+    ret = sched_setaffinity(0, sizeof(saved), &saved);
+    assert(ret == 0);
+    ::syscall(SYS_set_mempolicy, 0, nullptr, 0);
+    std::cout << kThreads << " loop thread(s) placed on cpu " << cpu << ", node " << node << std::endl;
+}
+
+} // anonymous namespace
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_WARN);
+    testTopology();
+    testThreadPool();
+    testTcpServer();
+    std::cout << "test_ThreadPlacement passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,233 @@
+#undef NDEBUG // 测试依赖assert，Release下也需要生效
+
+#include <EventLoop.hpp>
+#include <TimingWheel.hpp>
+#include <Logger.hpp>
+
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iostream>
+
+using namespace mudong::ev;
+using namespace std::chrono;
+
+// 统计全局分配次数，用于验证定时器槽位池在稳态下不再分配内存
+std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+// 用模拟的时间推进时间轮，验证定时器不会提前取出，最多比到期时刻晚一个tick，且nextExpiration最多比最早的到期时刻晚一个tick
+void testTimingWheel() {
+    TimingWheel wheel;
+    Timestamp base = clock::now();
+
+    std::mt19937_64 rng(7);
+    std::vector<Nanoseconds> delays = {0ms, 1ms, 255ms, 256ms, 257ms, 70s, 2h, 30h};
+    for (int i = 0; i < 500; ++i) {
+        delays.push_back(Microseconds(rng() % 100000000)); // 0 ~ 100s
+    }
+    std::vector<std::unique_ptr<Timer>> timers;
+    for (auto delay : delays) {
+        timers.push_back(std::make_unique<Timer>(nullptr, base + delay, Nanoseconds::zero()));
+        wheel.insert(timers.back().get());
+    }
+    // 取消一部分
+    size_t remaining = timers.size();
+    for (size_t i = 8; i < timers.size(); i += 7) {
+        wheel.erase(timers[i].get());
+        timers[i]->cancel();
+        --remaining;
+    }
+
+    Timestamp now = base;
+    Timestamp last = base - 1ns;
+    std::vector<Timer*> expired;
+    while (!wheel.empty()) {
+        Timestamp earliest = Timestamp::max();
+        for (auto& timer : timers) {
+            if (!timer->canceled() && timer->when() > last) {
+                earliest = std::min(earliest, timer->when());
+            }
+        }
+        assert(wheel.nextExpiration() <= std::max(earliest, now) + 1ms);
+
+        // 大部分时候按随机步长推进，偶尔直接跳到下一次检查的时刻
+        now = rng() % 4 == 0 ? std::max(now, wheel.nextExpiration()) : now + Microseconds(rng() % 300000);
+        if (now > base + 20h) {
+            now += 1h;
+        }
+        expired.clear();
+        wheel.takeExpired(now, expired);
+        for (Timer* timer : expired) {
+            assert(!timer->canceled());
+            assert(timer->when() <= now);
+            assert(timer->when() > last - 1ms);
+            timer->cancel(); // 标记为已取出
+            --remaining;
+        }
+        last = now;
+    }
+    assert(remaining == 0);
+}
+
+// 通过EventLoop验证两种引擎、两种驱动方式下定时器都按时触发、重复与取消正常
+void testEngine(TimerEngine::Type type, TimerQueue::Mode mode = TimerQueue::Mode::kTimerfd, bool precise = false) {
+    EventLoop loop;
+    loop.setTimerEngine(type);
+    loop.setTimerMode(mode, precise);
+
+    Timestamp start = loop.now();
+    std::vector<int> order;
+    for (int i : {5, 1, 300, 3}) {
+        loop.runAfter(Milliseconds(i), [&, i]() {
+            assert(clock::now() >= start + Milliseconds(i));
+            order.push_back(i);
+        });
+    }
+    TimerId canceled = loop.runAfter(100ms, []() { assert(false); });
+    loop.cancelTimer(canceled);
+    int repeats = 0;
+    loop.runEvery(20ms, [&]() { ++repeats; });
+    loop.runAfter(400ms, [&]() { loop.quit(); });
+    loop.loop();
+
+    assert((order == std::vector<int>{1, 3, 5, 300}));
+    assert(repeats >= 15);
+    std::cout << TimerEngine::typeName(type) << (mode == TimerQueue::Mode::kTimerfd ? ", timerfd" : ", poll timeout")
+              << (precise ? ", precise" : "") << ": " << repeats << " repeats" << std::endl;
+}
+
+// 亚毫秒级的定时器：不会提前触发，precise模式下平均延迟应明显小于1ms的取整
+void testPrecision(TimerQueue::Mode mode, bool precise) {
+    EventLoop loop;
+    loop.setTimerMode(mode, precise);
+
+    const int kRounds = 200;
+    int rounds = 0;
+    Nanoseconds totalLate(0);
+    std::function<void()> next = [&]() {
+        Timestamp when = clock::now() + 200us;
+        loop.runAt(when, [&, when]() {
+            Nanoseconds late = clock::now() - when;
+            assert(late >= Nanoseconds::zero());
+            totalLate += late;
+            if (++rounds == kRounds) {
+                loop.quit();
+            }
+            else next();
+        });
+    };
+    next();
+    loop.loop();
+    auto avgUs = duration_cast<Microseconds>(totalLate / kRounds).count();
+    std::cout << (mode == TimerQueue::Mode::kTimerfd ? "timerfd" : "poll timeout") << (precise ? ", precise" : "")
+              << ": average lateness of 200us timers " << avgUs << "us" << std::endl;
+}
+
+// 已触发、已取消或槽位被复用后的TimerId再取消是安全的空操作，且不会影响复用该槽位的新定时器
+void testStaleTimerId() {
+    EventLoop loop;
+
+    int fired = 0;
+    TimerId once = loop.runAfter(1ms, [&]() { ++fired; });
+    TimerId self;
+    self = loop.runEvery(1ms, [&]() {
+        loop.cancelTimer(self); // 在自身的回调中取消
+        loop.cancelTimer(self);
+        ++fired;
+    });
+    loop.runAfter(20ms, [&]() {
+        loop.cancelTimer(once); // 已经触发过
+        loop.cancelTimer(TimerId());
+        // 新定时器复用刚回收的槽位，过期的句柄不能取消它
+        TimerId reused = loop.runAfter(5ms, [&]() { ++fired; });
+        loop.cancelTimer(once);
+        loop.cancelTimer(self);
+        TimerId canceled = loop.runAfter(5ms, []() { assert(false); });
+        loop.cancelTimer(canceled);
+        loop.cancelTimer(canceled);
+        (void)reused;
+    });
+    loop.runAfter(50ms, [&]() { loop.quit(); });
+    loop.loop();
+    assert(fired == 3);
+}
+
+// 槽位池预热之后，在loop线程中反复添加与取消定时器不再经过全局分配器（时间轮引擎本身也不分配）
+void testNoAllocation() {
+    EventLoop loop;
+    loop.setTimerEngine(TimerEngine::Type::kTimingWheel);
+
+    std::vector<TimerId> ids(1000);
+    auto churn = [&]() {
+        for (auto& id : ids) {
+            id = loop.runAfter(10s, [](){});
+        }
+        for (auto id : ids) {
+            loop.cancelTimer(id);
+        }
+    };
+    churn();
+    size_t before = allocations.load();
+    for (int i = 0; i < 10; ++i) {
+        churn();
+    }
+    assert(allocations.load() == before);
+}
+
+// loop线程中now()在同一轮迭代内保持不变，且单调不减
+void testCachedNow() {
+    EventLoop loop;
+    Timestamp last = loop.now();
+    int rounds = 0;
+    std::function<void()> tick = [&]() {
+        Timestamp now = loop.now();
+        assert(now >= last);
+        assert(now <= clock::now());
+        std::this_thread::sleep_for(100us);
+        assert(loop.now() == now);
+        last = now;
+        if (++rounds == 10) {
+            loop.quit();
+        }
+        else loop.runAfter(1ms, tick);
+    };
+    loop.runAfter(1ms, tick);
+    loop.loop();
+}
+
+int main() {
+    setLogLevel(LOG_LEVEL::LOG_LEVEL_INFO);
+    testTimingWheel();
+    testEngine(TimerEngine::Type::kOrderedSet);
+    testEngine(TimerEngine::Type::kTimingWheel);
+    testEngine(TimerEngine::Type::kOrderedSet, TimerQueue::Mode::kPollTimeout);
+    testEngine(TimerEngine::Type::kTimingWheel, TimerQueue::Mode::kPollTimeout);
+    testEngine(TimerEngine::Type::kOrderedSet, TimerQueue::Mode::kPollTimeout, true);
+    for (auto mode : {TimerQueue::Mode::kTimerfd, TimerQueue::Mode::kPollTimeout}) {
+        testPrecision(mode, false);
+        testPrecision(mode, true);
+    }
+    testStaleTimerId();
+    testNoAllocation();
+    testCachedNow();
+    std::cout << "test_TimerQueue passed" << std::endl;
+    return 0;
+}